@@ -25,6 +25,7 @@
  */
 
 #pragma once
+#include "EigenConfig.h"
 #include <Eigen/Dense>
 using namespace Eigen;
 typedef Eigen::Matrix<double, 2, 1, Eigen::DontAlign> Vector2D; // do this to avoid alignment issues
@@ -51,5 +52,7 @@ struct AgentInitialParameters {
 	int gid;
 	/// The id of the agent
 	int id;
+	/// The simulation time at which the agent enters the simulation. Set by the engine
+	double spawnTime;
 };
 
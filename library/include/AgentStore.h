@@ -0,0 +1,131 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+*  @file       AgentStore.h
+*  @brief      Contains the AgentStore class.
+*/
+
+#pragma once
+#include <vector>
+#include "AgentInitialParameters.h"
+using std::vector;
+
+class ImplicitAgent;
+class TaskPool;
+
+/// The orders in which the agents can be kept in the store. Along a space-filling curve, agents that are close in the world are mostly close in memory
+enum SpatialOrder { InsertionOrder, MortonOrder, HilbertOrder };
+
+/**
+* @brief Structure-of-arrays storage of the active agents.
+*
+* Slot i holds the agent whose active id is i, so the slots are always compacted. 2D quantities are
+* interleaved, i.e. the x coordinate of slot i is at 2i and the y coordinate at 2i+1. This way the first
+* 2*size() entries of the arrays can be used directly as the variables of the implicit problem.
+*/
+class AgentStore
+{
+public:
+	/// Default constructor
+	AgentStore();
+	/// Adds an agent given its initial parameters and returns its slot
+	int add(ImplicitAgent* agent, const AgentInitialParameters& parameters);
+	/// Removes the agent in the given slot by moving the last agent into it
+	void remove(int slot);
+	/// Exchanges the agents in the two slots
+	void swap(int a, int b);
+	/// Makes sure that the given number of agents can be stored without reallocating
+	void reserve(int n);
+	/// Moves the agents so that slot i holds the agent of slot order[i], for the first order.size() slots, and updates their active ids
+	void reorder(const vector<int>& order);
+	/// Sorts the first count agents along the given curve through their current positions
+	void sortAlong(SpatialOrder curve, int count);
+	/// Moves the arrays of the agent state to fresh memory, whose pages are first touched by the threads of the pool that evaluate the
+	/// agents they hold: thread t of n touches the slots from t*size()/n to (t+1)*size()/n, and its share of the free slots.
+	/// With hugePages, the arrays are backed by huge pages where the system supports it
+	void place(TaskPool& pool, bool hugePages);
+
+	/// @name Get/Set functionality
+	//@{
+	/// Returns the number of stored agents
+	int size() const { return _size; }
+	/// Returns the number of agents that fit in the arrays before they are reallocated
+	int capacity() const { return _capacity; }
+	/// Returns the agent stored in the given slot
+	ImplicitAgent* agent(int slot) const { return _agents[slot]; }
+	/// Returns the position of the agent in the given slot
+	Vector2D position(int slot) const { return Vector2D(_position[2 * slot], _position[2 * slot + 1]); }
+	/// Returns the velocity of the agent in the given slot
+	Vector2D velocity(int slot) const { return Vector2D(_velocity[2 * slot], _velocity[2 * slot + 1]); }
+	/// Returns the preferred velocity of the agent in the given slot
+	Vector2D vPref(int slot) const { return Vector2D(_vPref[2 * slot], _vPref[2 * slot + 1]); }
+	/// Returns the goal of the agent in the given slot
+	Vector2D goal(int slot) const { return Vector2D(_goal[2 * slot], _goal[2 * slot + 1]); }
+	/// Returns the radius of the agent in the given slot
+	double radius(int slot) const { return _radius[slot]; }
+	/// Returns the preferred speed of the agent in the given slot
+	double prefSpeed(int slot) const { return _prefSpeed[slot]; }
+	/// Returns the squared goal radius of the agent in the given slot
+	double goalRadiusSq(int slot) const { return _goalRadiusSq[slot]; }
+	/// Returns the group id of the agent in the given slot
+	int gid(int slot) const { return _gid[slot]; }
+	/// Returns the id of the agent in the given slot
+	int id(int slot) const { return _id[slot]; }
+	/// Sets the position of the agent in the given slot
+	void setPosition(int slot, const Vector2D& p) { _position[2 * slot] = p.x(); _position[2 * slot + 1] = p.y(); }
+	/// Sets the velocity of the agent in the given slot
+	void setVelocity(int slot, const Vector2D& v) { _velocity[2 * slot] = v.x(); _velocity[2 * slot + 1] = v.y(); }
+	/// Sets the preferred velocity of the agent in the given slot
+	void setVPref(int slot, const Vector2D& v) { _vPref[2 * slot] = v.x(); _vPref[2 * slot + 1] = v.y(); }
+	/// Sets the goal of the agent in the given slot
+	void setGoal(int slot, const Vector2D& g) { _goal[2 * slot] = g.x(); _goal[2 * slot + 1] = g.y(); }
+	//@}
+
+	/// @name Direct access to the arrays. Only the first size() (or 2*size() for 2D quantities) entries are valid
+	//@{
+	const VectorXd& positions() const { return _position; }
+	VectorXd& positions() { return _position; }
+	const VectorXd& velocities() const { return _velocity; }
+	VectorXd& velocities() { return _velocity; }
+	const VectorXd& vPrefs() const { return _vPref; }
+	VectorXd& vPrefs() { return _vPref; }
+	const VectorXd& goals() const { return _goal; }
+	const VectorXd& radii() const { return _radius; }
+	const VectorXd& prefSpeeds() const { return _prefSpeed; }
+	const vector<int>& gids() const { return _gid; }
+	const vector<int>& ids() const { return _id; }
+	//@}
+
+protected:
+	/// The number of stored agents
+	int _size;
+	/// The number of agents that fit in the arrays
+	int _capacity;
+	/// The agent in each slot
+	vector<ImplicitAgent*> _agents;
+	/// Interleaved 2D quantities
+	VectorXd _position, _velocity, _vPref, _goal;
+	/// Per-agent scalar quantities
+	VectorXd _radius, _prefSpeed, _goalRadiusSq;
+	/// The group ids and the ids of the agents
+	vector<int> _gid, _id;
+};
@@ -0,0 +1,131 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+*  @file       Calibration.h
+*  @brief      Contains the Calibration class and the objectives it minimizes.
+*/
+
+#pragma once
+#include "Ensemble.h"
+
+/**
+* @brief An objective evaluated on a trajectory while it is being simulated. Lower is better.
+*/
+class CalibrationObjective
+{
+public:
+	/// Destructor
+	virtual ~CalibrationObjective() {}
+	/// Returns a fresh copy of the objective, used to evaluate a single run
+	virtual CalibrationObjective* clone() const = 0;
+	/// Called after every simulation step
+	virtual void update(const ImplicitEngine& engine) = 0;
+	/// Called once a run has ended, possibly before the end of the observed data, e.g. because all agents arrived or the maximum number of
+	/// steps was reached, so that the objective can account for the rest of the data
+	virtual void finish(const ImplicitEngine& /*engine*/) {}
+	/// Returns the value of the objective for the steps seen so far
+	virtual double value() const = 0;
+	/// Returns a lower bound of the final value given the steps seen so far. Runs whose bound cannot beat the best
+	/// run are aborted. The default assumes that the objective never decreases over time, e.g. a sum of squared errors
+	virtual double lowerBound() const { return value(); }
+};
+
+/**
+* @brief Compares the number of agents leaving the simulation per time window with observed counts.
+*/
+class ArrivalRateObjective : public CalibrationObjective
+{
+public:
+	/// Constructor given the length of a window in seconds, and the observed number of arrivals in each window
+	ArrivalRateObjective(double window, const vector<double>& observed);
+	CalibrationObjective* clone() const { return new ArrivalRateObjective(*this); }
+	void update(const ImplicitEngine& engine);
+	/// Scores the window in which the run ended with the arrivals so far, and the windows after it with no arrivals
+	void finish(const ImplicitEngine& engine);
+	/// The sum of squared differences over the windows completed so far
+	double value() const { return _error; }
+
+protected:
+	double _window;
+	vector<double> _observed;
+	/// The index of the current window, and the arrivals at its start
+	int _current;
+	int _arrivedAtStart;
+	double _error;
+};
+
+/// The outcome of a single point of a calibration
+struct CalibrationResult
+{
+	/// The value of each swept parameter, in the order of the ranges
+	vector<double> values;
+	/// The objective; for aborted runs the value when they were stopped, infinite for stalled runs
+	double objective;
+	/// The number of simulated steps
+	int steps;
+	/// Whether the run was stopped because it could not beat the best run
+	bool aborted;
+	/// Whether the run was stopped because the agents stopped moving
+	bool stalled;
+};
+
+/**
+* @brief Sweeps parameters of the engine over a grid and keeps the point that minimizes an objective.
+*
+* All points run in parallel through an Ensemble. The objective is evaluated while the runs progress, so that runs
+* that cannot beat the best point so far or whose agents have stalled are stopped early. Nothing is written to disk.
+*/
+class Calibration
+{
+public:
+	/// Constructor given the shared scenario, the parameters that are not swept, and the objective
+	Calibration(const Scenario& scenario, const Parser& baseParameters, const CalibrationObjective& objective);
+	/// Sweeps a parameter (a key of implicit.ini) over the given number of equidistant samples in [min, max]
+	void addRange(const string& key, double min, double max, int samples);
+	/// Stops runs whose mean agent speed stays below the given speed for the given number of steps. A non-positive number of steps disables the check
+	void setStallDetection(double speed, int steps) { _stallSpeed = speed; _stallSteps = steps; }
+	/// Gives access to the underlying ensemble, e.g. to set the time step or the concurrency
+	Ensemble& getEnsemble() { return _ensemble; }
+	/// Runs the sweep and blocks until it has finished. Returns the index of the best result, or -1 if all runs stalled
+	int run();
+	/// Returns the results of all points, in grid order
+	const vector<CalibrationResult>& getResults() const { return _results; }
+
+protected:
+	class Observer;
+
+	/// A swept parameter
+	struct Range
+	{
+		string key;
+		double min, max;
+		int samples;
+	};
+
+	const Parser& _baseParameters;
+	const CalibrationObjective& _objective;
+	Ensemble _ensemble;
+	vector<Range> _ranges;
+	vector<CalibrationResult> _results;
+	double _stallSpeed;
+	int _stallSteps;
+};
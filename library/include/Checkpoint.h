@@ -0,0 +1,139 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+/*!
+*  @file       Checkpoint.h
+*  @brief      Contains the binary streams used to save and restore the state of an engine.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+#include "AgentInitialParameters.h"
+using namespace std;
+
+/// FNV-1a hashing of the bytes of a plain value, e.g. to name the cached files of some geometry
+template <typename T>
+void hashValue(unsigned long long& h, const T& value)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+	for (size_t i = 0; i < sizeof(T); ++i)
+	{
+		h ^= bytes[i];
+		h *= 1099511628211ULL;
+	}
+}
+
+/// The initial value of an FNV-1a hash
+const unsigned long long hashSeed = 14695981039346656037ULL;
+
+/** 
+  * @brief Serializes values into an in-memory binary buffer.
+  *
+  * Values are written in the native byte order, so checkpoints can only be restored on a machine with the same endianness.
+  */
+class CheckpointWriter
+{
+public:
+	/// Appends a plain value
+	template <typename T>
+	void write(const T& value)
+	{
+		const char* bytes = reinterpret_cast<const char*>(&value);
+		_data.append(bytes, sizeof(T));
+	}
+	/// Appends a 2D vector
+	void write(const Vector2D& v) { write(v.x()); write(v.y()); }
+	/// Appends a string, preceded by its length
+	void write(const string& s);
+	/// Appends a list of 2D vectors, preceded by its length
+	void write(const vector<Vector2D>& v);
+	/// Appends a list of integers, preceded by its length
+	void write(const vector<int>& v);
+	/// Appends an array of plain values, without its length
+	template <typename T>
+	void writeArray(const T* values, size_t n) { _data.append(reinterpret_cast<const char*>(values), n*sizeof(T)); }
+	/// Returns the serialized data
+	const string& data() const { return _data; }
+	/// Writes the serialized data to a file. The data is written to a temporary file first, so an existing checkpoint is not lost if writing fails
+	bool writeToFile(const string& fileName) const;
+
+protected:
+	string _data;
+};
+
+/** 
+  * @brief Reads back the values written by a CheckpointWriter.
+  *
+  * Reading past the end of the data fails silently; check good() once everything has been read.
+  */
+class CheckpointReader
+{
+public:
+	CheckpointReader() : _pos(0), _good(true) {}
+	/// Reads data that is already in memory, e.g. received from another process
+	explicit CheckpointReader(const string& data) : _data(data), _pos(0), _good(true) {}
+	/// Loads the whole file in memory. Returns false if the file cannot be read
+	bool readFromFile(const string& fileName);
+	/// Reads a plain value
+	template <typename T>
+	void read(T& value)
+	{
+		if (!_good || _data.size() - _pos < sizeof(T))
+		{
+			_good = false;
+			return;
+		}
+		memcpy(&value, _data.data() + _pos, sizeof(T));
+		_pos += sizeof(T);
+	}
+	/// Reads a 2D vector
+	void read(Vector2D& v) { double x = 0, y = 0; read(x); read(y); v = Vector2D(x, y); }
+	/// Reads a string
+	void read(string& s);
+	/// Reads a list of 2D vectors
+	void read(vector<Vector2D>& v);
+	/// Reads a list of integers
+	void read(vector<int>& v);
+	/// Reads an array of n plain values
+	template <typename T>
+	void readArray(T* values, size_t n)
+	{
+		if (!_good || (_data.size() - _pos) / sizeof(T) < n)
+		{
+			_good = false;
+			return;
+		}
+		memcpy(values, _data.data() + _pos, n*sizeof(T));
+		_pos += n*sizeof(T);
+	}
+	/// Reads a length and makes sure that at least that many elements of the given size can follow. Guards the allocations against corrupted files
+	size_t readSize(size_t elementSize);
+	/// Returns false if some read went past the end of the data
+	bool good() const { return _good; }
+	/// Returns true if all data has been read
+	bool atEnd() const { return _pos == _data.size(); }
+
+protected:
+	string _data;
+	size_t _pos;
+	bool _good;
+};
@@ -0,0 +1,82 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+/*!
+*  @file       DistanceField.h
+*  @brief      Contains the DistanceField class.
+*/
+
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "Obstacles.h"
+using namespace std;
+
+/**
+* @brief The distance to the closest obstacle, sampled on a regular grid.
+*
+* The field is baked once for a set of obstacles and then answers distance queries with a bilinear lookup, whose cost
+* does not depend on the number of obstacles. Distances are clamped to a margin around the obstacles, and points
+* outside the field are reported at the margin. Fields are immutable, so engines with the same obstacles share them.
+*/
+class DistanceField
+{
+public:
+	/// Returns the field of the obstacles, sampled every cellSize. The field is shared with the other users of the same geometry in this process,
+	/// otherwise it is read from the cache directory, or baked and written to it. An empty directory disables the disk cache. Callers asking for a
+	/// field that is being baked wait for it, while fields of other geometries are baked concurrently
+	static shared_ptr<const DistanceField> obtain(const ObstacleGrid& obstacles, double cellSize, double margin, const string& cacheDirectory);
+	/// Returns the interpolated distance at p, and optionally its gradient
+	double distance(const Vector2D& p, Vector2D* gradient = NULL) const;
+
+	/// @name Get functionality
+	//@{
+	/// Returns the distance beyond which obstacles are ignored
+	double getMargin() const { return _margin; }
+	/// Returns the spacing of the samples
+	double getCellSize() const { return _cellSize; }
+	/// Returns the hash of the geometry and of the sampling, which names the cached file
+	unsigned long long getHash() const { return _hash; }
+	//@}
+
+protected:
+	DistanceField();
+	/// Computes the distance of every sample, propagating the closest segment from the samples around the obstacles
+	void bake(const ObstacleGrid& obstacles, double cellSize, double margin);
+	/// Reads a cached field, returns false if the file is missing or was written for different obstacles
+	bool load(const string& fileName);
+	/// Writes the field to the cache
+	bool save(const string& fileName) const;
+	/// Hashes the obstacles and the sampling parameters
+	static unsigned long long hash(const ObstacleGrid& obstacles, double cellSize, double margin);
+
+protected:
+	/// The position of the first sample, the spacing of the samples and their number per axis
+	Vector2D _origin;
+	double _cellSize;
+	int _xNodes, _yNodes;
+	/// The largest distance stored
+	double _margin;
+	/// The hash of the geometry
+	unsigned long long _hash;
+	/// The samples, row by row
+	vector<float> _distance;
+};
@@ -0,0 +1,81 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+*  @file       DomainDecomposition.h
+*  @brief      Contains the partition of the world into slabs owned by the processes of a distributed (MPI) run.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+using namespace std;
+
+/// Distributed runs are only available when IMPLICIT_MPI is defined, otherwise the statements compile to nothing
+#ifdef IMPLICIT_MPI
+#define DISTRIBUTED(statement) statement
+#include <mpi.h>
+
+/** 
+  * @brief Splits the world into vertical slabs, one per process, and wraps the communication between the processes.
+  *
+  * Every process owns the agents whose x coordinate falls in its slab. The slabs are placed so that the processes own
+  * about the same number of agents, and can be moved while the simulation runs.
+  */
+class DomainDecomposition
+{
+public:
+	/// Creates a decomposition over the processes of the communicator. Initially the first process owns the whole world
+	DomainDecomposition(MPI_Comm comm);
+
+	/// Returns the rank of this process
+	int rank() const { return _rank; }
+	/// Returns the number of processes
+	int size() const { return _size; }
+	/// Returns the rank owning the slab that contains the given x coordinate
+	int owner(double x) const;
+	/// Finds the ranks, other than this one, whose slabs are closer than the given distance to the given x coordinate
+	void ranksNear(double x, double distance, vector<int>& ranks) const;
+	/// Moves the slabs so that every process owns about the same number of the given x coordinates, i.e. of those of its agents. Collective
+	void balance(const vector<double>& x);
+
+	/// Returns the sum of the given value over all processes. Collective
+	double sum(double value) const;
+	/// Returns the maximum of the given value over all processes. Collective
+	double max(double value) const;
+	/// Sends one buffer to every process and receives one from every process, of any length. Collective
+	void exchange(const vector<string>& send, vector<string>& received) const;
+	/// Sends one buffer to every process and receives one from every process, whose lengths are already known by the receivers.
+	/// Only the processes with something to send or to receive talk to each other
+	void exchange(const vector<vector<double> >& send, vector<vector<double> >& received) const;
+
+protected:
+	MPI_Comm _comm;
+	int _rank, _size;
+	/// The x coordinates between consecutive slabs
+	vector<double> _cuts;
+	/// The number of bins of the histogram that places the slabs
+	static const int _bins = 4096;
+};
+
+#else
+#define DISTRIBUTED(statement)
+#endif
@@ -0,0 +1,36 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+*  @file       EigenConfig.h
+*  @brief      Contains the configuration of Eigen shared by the whole library.
+*/
+
+#pragma once
+// Eigen reads its configuration when its headers are first included, so this header has to come before any of them in every
+// translation unit, otherwise the same Eigen types would be compiled differently in different files.
+#ifdef _DEBUG
+/// Debug builds count the heap allocations of Eigen vectors and matrices, and the temporaries of their products, made by each thread,
+/// e.g. to check that the solver makes none. Eigen expands the hook wherever it creates storage of the given size. Other heap
+/// allocations, e.g. of standard containers, are not counted
+inline long long& eigenAllocations() { static thread_local long long allocations = 0; return allocations; }
+#define EIGEN_DENSE_STORAGE_CTOR_PLUGIN if (size != 0) ++::eigenAllocations();
+#endif
@@ -0,0 +1,579 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+*  @file       EnergyTerms.h
+*  @brief      Contains the terms of the implicit energy and the EnergyModel that fuses them.
+*/
+
+#pragma once
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "Obstacles.h"
+#include "DistanceField.h"
+using std::vector;
+
+#define _INFTY 9e9
+
+/**
+* @brief The state an energy is evaluated at: the start of the step, and the candidate velocities of the agents in the problem.
+*
+* The 2D quantities are interleaved as in the AgentStore.
+*/
+struct EnergyState
+{
+	/// The time step
+	double dt;
+	/// The positions, velocities and preferred velocities at the start of the step
+	const double* position;
+	const double* velocity;
+	const double* vPref;
+	/// The radii of the agents
+	const double* radius;
+	/// The candidate velocities, and the positions they lead to at the end of the step
+	const double* vNew;
+	const double* posNew;
+};
+
+/**
+* @brief A pair of neighboring agents a and b, seen from a, the agent the gradient is taken for.
+*
+* Agent b moves with its candidate velocity, or with its current velocity if it is not part of the problem.
+*/
+struct AgentPair
+{
+	/// The sum of the radii
+	double radius;
+	/// The positions at the start of the step
+	double Pa_x, Pa_y, Pb_x, Pb_y;
+	/// The positions at the end of the step
+	double PaNew_x, PaNew_y, PbNew_x, PbNew_y;
+	/// The velocities across the step
+	double Va_x, Va_y, Vb_x, Vb_y;
+};
+
+/**
+* @brief The base of the terms of the implicit energy.
+*
+* A term adds its energy to f, and with Gradient also its gradient with respect to the velocity of the agent to grad, in
+*	template <bool Gradient> bool agentEnergy(const EnergyState& state, int i, double& f, double* grad) const
+* for a single agent and/or in
+*	template <bool Gradient> bool pairEnergy(const EnergyState& state, const AgentPair& pair, double& f, double* grad) const
+* for a pair of neighbors, and sets hasAgentEnergy or hasPairEnergy accordingly. Both return false if the velocities are infeasible.
+* The EnergyModel resolves the calls at compile time, so a term costs neither an indirect call nor a pass of its own.
+*/
+template <class Derived>
+class EnergyTerm
+{
+public:
+	static const bool hasAgentEnergy = false;
+	static const bool hasPairEnergy = false;
+
+	/// Adds the energy of agent i
+	template <bool Gradient>
+	bool evaluateAgent(const EnergyState& state, int i, double& f, double* grad) const { return derived().template agentEnergy<Gradient>(state, i, f, grad); }
+	/// Adds the energy of a pair of neighbors
+	template <bool Gradient>
+	bool evaluatePair(const EnergyState& state, const AgentPair& pair, double& f, double* grad) const { return derived().template pairEnergy<Gradient>(state, pair, f, grad); }
+
+	/// The defaults add nothing
+	template <bool Gradient>
+	bool agentEnergy(const EnergyState&, int, double&, double*) const { return true; }
+	template <bool Gradient>
+	bool pairEnergy(const EnergyState&, const AgentPair&, double&, double*) const { return true; }
+
+protected:
+	const Derived& derived() const { return static_cast<const Derived&>(*this); }
+};
+
+/**
+* @brief A fixed list of energy terms, evaluated together.
+*
+* agentEnergy and pairEnergy call the terms in the order of the list and stop at the first infeasible one. Terms without
+* energy of the kind are skipped at compile time.
+*/
+template <class... Terms>
+class EnergyModel;
+
+template <>
+class EnergyModel<>
+{
+public:
+	static const bool hasAgentEnergy = false;
+	static const bool hasPairEnergy = false;
+	template <bool Gradient>
+	bool agentEnergy(const EnergyState&, int, double&, double*) const { return true; }
+	template <bool Gradient>
+	bool pairEnergy(const EnergyState&, const AgentPair&, double&, double*) const { return true; }
+
+protected:
+	template <class T> struct Tag {};
+	void get() {}
+};
+
+template <class Term, class... Rest>
+class EnergyModel<Term, Rest...> : public EnergyModel<Rest...>
+{
+	typedef EnergyModel<Rest...> Base;
+public:
+	static const bool hasAgentEnergy = Term::hasAgentEnergy || Base::hasAgentEnergy;
+	static const bool hasPairEnergy = Term::hasPairEnergy || Base::hasPairEnergy;
+
+	/// Adds the energy of agent i, summed over the terms
+	template <bool Gradient>
+	bool agentEnergy(const EnergyState& state, int i, double& f, double* grad) const
+	{
+		return (!Term::hasAgentEnergy || _term.template evaluateAgent<Gradient>(state, i, f, grad)) && Base::template agentEnergy<Gradient>(state, i, f, grad);
+	}
+	/// Adds the energy of a pair of neighbors, summed over the terms
+	template <bool Gradient>
+	bool pairEnergy(const EnergyState& state, const AgentPair& pair, double& f, double* grad) const
+	{
+		return (!Term::hasPairEnergy || _term.template evaluatePair<Gradient>(state, pair, f, grad)) && Base::template pairEnergy<Gradient>(state, pair, f, grad);
+	}
+	/// Returns the term of the given type, e.g. to set its parameters
+	template <class T>
+	T& term() { return get(typename Base::template Tag<T>()); }
+
+protected:
+	using Base::get;
+	Term& get(typename Base::template Tag<Term>) { return _term; }
+
+	Term _term;
+};
+
+/**
+* @brief The acceleration term, which keeps the velocities close to those at the start of the step.
+*/
+class AccelerationTerm : public EnergyTerm<AccelerationTerm>
+{
+public:
+	static const bool hasAgentEnergy = true;
+
+	template <bool Gradient>
+	bool agentEnergy(const EnergyState& state, int i, double& f, double* grad) const
+	{
+		double dx = state.vNew[2 * i] - state.velocity[2 * i];
+		double dy = state.vNew[2 * i + 1] - state.velocity[2 * i + 1];
+		f += 0.5*state.dt*(dx*dx + dy*dy);
+		if (Gradient)
+		{
+			grad[0] += dx / state.dt;
+			grad[1] += dy / state.dt;
+		}
+		return true;
+	}
+};
+
+/**
+* @brief The goal term, which pulls the velocities towards the preferred velocities.
+*/
+class GoalTerm : public EnergyTerm<GoalTerm>
+{
+public:
+	static const bool hasAgentEnergy = true;
+	/// The weight of the term
+	double ksi;
+
+	GoalTerm() : ksi(2.) {}
+
+	template <bool Gradient>
+	bool agentEnergy(const EnergyState& state, int i, double& f, double* grad) const
+	{
+		double dx = state.vNew[2 * i] - state.vPref[2 * i];
+		double dy = state.vNew[2 * i + 1] - state.vPref[2 * i + 1];
+		f += 0.5*ksi*(dx*dx + dy*dy);
+		if (Gradient)
+		{
+			grad[0] += ksi*dx;
+			grad[1] += ksi*dy;
+		}
+		return true;
+	}
+};
+
+/**
+* @brief The anticipatory term, a power law of the inverse time to collision between neighbors.
+*/
+class TtcTerm : public EnergyTerm<TtcTerm>
+{
+public:
+	static const bool hasPairEnergy = true;
+	/// The scale, the exponent and the time horizon of the power law
+	double k, p, t0;
+	/// The fraction of the combined radius below which the inverse time to collision is extrapolated linearly
+	double eps;
+
+	TtcTerm() : k(1.5), p(2.), t0(3.), eps(0.2) {}
+
+	template <bool Gradient>
+	bool pairEnergy(const EnergyState& state, const AgentPair& pair, double& f, double* grad) const
+	{
+		f += energy(pair.PaNew_x, pair.PaNew_y, pair.PbNew_x, pair.PbNew_y, pair.Va_x, pair.Va_y, pair.Vb_x, pair.Vb_y, pair.radius, state.dt, Gradient ? grad : NULL);
+		return true;
+	}
+
+	/// Returns the energy of agent a at the end of the step for the given relative motion, and adds its gradient if grad is not NULL.
+	/// A static obstacle point is an agent b at rest. TODO: Use a different approximation than the linear extrapolation mentioned in the paper
+	double energy(double Pa_x, double Pa_y, double Pb_x, double Pb_y, double Va_x, double Va_y, double Vb_x, double Vb_y, double radius, double dt, double* grad) const;
+};
+
+/**
+* @brief The distance term, which repels neighbors from each other and rejects velocities that make their paths overlap within the step.
+*/
+class DistanceTerm : public EnergyTerm<DistanceTerm>
+{
+public:
+	static const bool hasPairEnergy = true;
+	/// The weight of the term
+	double eta;
+
+	DistanceTerm() : eta(0.01) {}
+
+	template <bool Gradient>
+	bool pairEnergy(const EnergyState& state, const AgentPair& pair, double& f, double* grad) const
+	{
+		double distance = 0;
+		if (energy(pair.Pa_x, pair.Pa_y, pair.Pb_x, pair.Pb_y, pair.Va_x, pair.Va_y, pair.Vb_x, pair.Vb_y, pair.radius, state.dt, distance, Gradient ? grad : NULL))
+			return false;
+		f += distance;
+		return true;
+	}
+
+	/// Computes the energy of the minimum distance between the two agents during the step, and adds its gradient if grad is not NULL.
+	/// Returns true if the agents come closer than their radius, i.e. tunnel through each other. TODO: Replace this with velocity uncertainty that will make this obsolete
+	bool energy(double Pa_x, double Pa_y, double Pb_x, double Pb_y, double Va_x, double Va_y, double Vb_x, double Vb_y, double radius, double dt, double& energy, double* grad) const;
+};
+
+/**
+* @brief The interaction of the agents with the static obstacles: the distance and anticipatory terms with each nearby segment, or with the closest
+* obstacle point when a distance field is used.
+*
+* The term reads the obstacles and the per-agent queries of the engine.
+*/
+class ObstacleTerm : public EnergyTerm<ObstacleTerm>
+{
+public:
+	static const bool hasAgentEnergy = true;
+	/// The weight of the distance energy
+	double eta;
+	/// The anticipatory term, evaluated with the obstacle points as static agents
+	const TtcTerm* ttc;
+	/// The obstacles, and the indices of the segments near each agent
+	const ObstacleGrid* obstacles;
+	const vector<vector<int>>* neighbors;
+	/// The distance field of the obstacles, or NULL to evaluate them exactly
+	const DistanceField* field;
+	/// With the distance field, the clearance of each agent and its closest obstacle point at the start of the step
+	const double* clearance;
+	const double* wallPoint;
+
+	ObstacleTerm() : eta(0.01), ttc(NULL), obstacles(NULL), neighbors(NULL), field(NULL), clearance(NULL), wallPoint(NULL) {}
+
+	template <bool Gradient>
+	bool agentEnergy(const EnergyState& state, int i, double& f, double* grad) const
+	{
+		if (obstacles->empty())
+			return true;
+		return field != NULL ? fieldEnergy(state, i, f, Gradient ? grad : NULL) : exactEnergy(state, i, f, Gradient ? grad : NULL);
+	}
+
+	/// Computes the energy of the minimum distance between the path of the agent and a segment, and adds its gradient if grad is not NULL.
+	/// Returns true if the agent comes closer than its radius, i.e. tunnels through the segment
+	bool distanceEnergy(double P_x, double P_y, double V_x, double V_y, const LineObstacle& obstacle, double radius, double dt, double& energy, double* grad) const;
+
+protected:
+	/// Evaluates the segments near agent i
+	bool exactEnergy(const EnergyState& state, int i, double& f, double* grad) const;
+	/// Evaluates the closest obstacle of agent i with the distance field, checking its path exactly only if it can reach an obstacle
+	bool fieldEnergy(const EnergyState& state, int i, double& f, double* grad) const;
+};
+
+// here gradients are explicitly computed, though a bit too verbose (autodiff and/or Eigen will slow things down a bit)
+inline double TtcTerm::energy(double Pa_x, double Pa_y, double Pb_x, double Pb_y, double Va_x, double Va_y, double Vb_x, double Vb_y, double radius, double dt, double* grad) const
+{
+	
+	double f = 0;
+
+	//relative velocity
+	double V_x = Va_x - Vb_x;
+	double V_y = Va_y - Vb_y;
+
+	//relative displacement
+	double X_x = Pb_x - Pa_x;
+	double X_y = Pb_y - Pa_y;
+	double x = sqrt(X_x*X_x + X_y*X_y);
+	double Xhat_x = X_x;
+	double Xhat_y = X_y;
+	if (x > 0)
+	{
+		Xhat_x /= x;
+		Xhat_y /= x;
+	}
+
+	//parallel component
+	double vp = Xhat_x*V_x + Xhat_y*V_y;
+	if (vp < 0) //agents are diverging
+	{
+		return 0;
+	}
+
+
+	//tangential component
+	double VT_x = V_x - vp*Xhat_x;
+	double VT_y = V_y - vp*Xhat_y;
+	double vt = sqrt(VT_x*VT_x + VT_y*VT_y);
+
+	double rSq = radius*radius;
+	double xMinR = x*x - rSq;
+	double xMinR_sqrt = sqrt(xMinR);
+	double nominator = sqrt(1 - eps*eps);
+	double vtstar = nominator*radius*vp / xMinR_sqrt;
+
+	if (vt < vtstar) // compute inv_ttc as usual
+	{
+		double discr = sqrt(rSq*vp*vp - xMinR*vt*vt);
+		double inv_ttc = (x*vp + discr) / xMinR;
+		if (inv_ttc > 0)
+		{
+			double mult = k*pow(inv_ttc, p - 1)*exp(-(1 / inv_ttc) / t0);
+			f = mult*inv_ttc;
+			if (grad != NULL)
+			{
+				double VP_x = vp*Xhat_x;
+				double VP_y = vp*Xhat_y;
+				double A_x = -X_x + V_x*dt - vp*dt*Xhat_x;
+				double A_y = -X_y + V_y*dt - vp*dt*Xhat_y;
+				double B_x = (((dt*vp + x)*VT_x)*xMinR / x - X_x*dt*vt*vt + rSq*vp*A_x / x) / discr + dt*VP_x;
+				double B_y = (((dt*vp + x)*VT_y)*xMinR / x - X_y*dt*vt*vt + rSq*vp*A_y / x) / discr + dt*VP_y;
+				grad[0] += -mult / xMinR*((A_x + B_x)*(p + 1 / (t0*inv_ttc)) - 2 * dt*(1 / t0 + p*inv_ttc)*X_x);
+				grad[1] += -mult / xMinR*((A_y + B_y)*(p + 1 / (t0*inv_ttc)) - 2 * dt*(1 / t0 + p*inv_ttc)*X_y);
+			}
+
+		}
+	}
+	else //linear extrapolation from vtstar
+	{
+		double inv_ttc = (x + eps*radius)*vp / xMinR - nominator / eps*(vt - vtstar) / xMinR_sqrt;
+		if (inv_ttc > 0)
+		{
+			double mult = k*exp(-(1 / inv_ttc) / t0);
+			f = mult*pow(inv_ttc, p);
+			if (grad != NULL)
+			{
+				double A_x = -X_x / x + V_x*dt / x - vp*dt*Xhat_x / x;
+				double A_y = -X_y / x + V_y*dt / x - vp*dt*Xhat_y / x;
+				double B_x = ((eps*radius + x)*A_x) / xMinR + (nominator*((VT_x*dt*vp / x + VT_x) / vt + radius*nominator / xMinR_sqrt*(A_x - dt*vp*X_x / (xMinR)))) / (eps*xMinR_sqrt) - dt*X_x / xMinR*(vp*(eps*radius + x) / xMinR - vp / x + inv_ttc);
+				double B_y = ((eps*radius + x)*A_y) / xMinR + (nominator*((VT_y*dt*vp / x + VT_y) / vt + radius*nominator / xMinR_sqrt*(A_y - dt*vp*X_y / (xMinR)))) / (eps*xMinR_sqrt) - dt*X_y / xMinR*(vp*(eps*radius + x) / xMinR - vp / x + inv_ttc);
+				mult *= -pow(inv_ttc, p - 1)*(p + 1 / (t0*inv_ttc));
+				grad[0] += mult*B_x;
+				grad[1] += mult*B_y;
+			}
+
+		}
+	}
+
+	return  f;
+}
+
+inline bool DistanceTerm::energy(double Pa_x, double Pa_y, double Pb_x, double Pb_y, double Va_x, double Va_y, double Vb_x, double Vb_y, double radius, double dt, double& energy, double* grad) const
+{
+	energy = 0;
+	double Xx = Pb_x - Pa_x;
+	double Xy = Pb_y - Pa_y;
+	double Vx = Va_x - Vb_x;
+	double Vy = Va_y - Vb_y;
+
+	double speed = Vx * Vx + Vy * Vy;
+	double rate = Xx*Vx + Xy*Vy;
+	double tti = rate / (speed + 1e-4); // add a bit of noise since when speed = 0, tti is not differentiable
+	tti = max(min(tti, dt), 0.);
+
+	double dx = Vx*tti - Xx;
+	double dy = Vy*tti - Xy;
+	double d = dx*dx + dy*dy;
+
+	if (d <= radius*radius) //tunelling
+	{
+		return true;
+	}
+
+	d = sqrt(d);
+	double distance = d - radius;
+	energy = min(eta/distance, _INFTY);
+
+	if (grad != NULL && rate >0)
+	{
+		double tti_prime_x = 0, tti_prime_y = 0;
+		if (tti > 0 && tti < dt)
+		{
+			double tti_prime_x = (Xx - 2 * tti*Vx) / speed;
+			double tti_prime_y = (Xy - 2 * tti*Vy) / speed;
+		}
+		double scale = -eta / (d * distance * distance);
+		double distance_prime_x = dx*(tti + Vx*tti_prime_x) + dy*(Vy*tti_prime_x);
+		double distance_prime_y = dy*(tti + Vy*tti_prime_y) + dx*(Vx*tti_prime_y);
+		grad[0] += scale*distance_prime_x;
+		grad[1] += scale*distance_prime_y;
+	}
+
+	return false;
+
+}
+
+inline bool ObstacleTerm::distanceEnergy(double P_x, double P_y, double V_x, double V_y, const LineObstacle& obstacle, double radius, double dt, double& energy, double* grad) const
+{
+	energy = 0;
+	// closest points between the path of the agent, P + s*V*dt, and the obstacle, A + t*(B - A), with s and t in [0, 1]
+	double D1x = V_x*dt, D1y = V_y*dt;
+	double D2x = obstacle.b.x() - obstacle.a.x(), D2y = obstacle.b.y() - obstacle.a.y();
+	double Rx = P_x - obstacle.a.x(), Ry = P_y - obstacle.a.y();
+	double a = D1x*D1x + D1y*D1y;
+	double e = D2x*D2x + D2y*D2y;
+	double f = D2x*Rx + D2y*Ry;
+	double s, t;
+	if (a <= 1e-12) // the agent is not moving
+	{
+		s = 0;
+		t = max(min(f / e, 1.), 0.);
+	}
+	else
+	{
+		double b = D1x*D2x + D1y*D2y;
+		double c = D1x*Rx + D1y*Ry;
+		double denominator = a*e - b*b;
+		s = denominator > 0 ? max(min((b*f - c*e) / denominator, 1.), 0.) : 0.;
+		t = (b*s + f) / e;
+		if (t < 0)
+		{
+			t = 0;
+			s = max(min(-c / a, 1.), 0.);
+		}
+		else if (t > 1)
+		{
+			t = 1;
+			s = max(min((b - c) / a, 1.), 0.);
+		}
+	}
+
+	double dx = Rx + D1x*s - D2x*t;
+	double dy = Ry + D1y*s - D2y*t;
+	double d = dx*dx + dy*dy;
+	if (d <= radius*radius) //tunelling
+		return true;
+
+	d = sqrt(d);
+	double distance = d - radius;
+	energy = min(eta / distance, _INFTY);
+
+	if (grad != NULL && s > 0)
+	{
+		// s and t minimize the distance, so only its explicit dependence on the velocity remains
+		double scale = -eta / (distance * distance) * s * dt / d;
+		grad[0] += scale*dx;
+		grad[1] += scale*dy;
+	}
+	return false;
+}
+
+inline bool ObstacleTerm::exactEnergy(const EnergyState& state, int i, double& f, double* grad) const
+{
+	const double* pos = state.position;
+	const double* vNew = state.vNew;
+	const double* posNew = state.posNew;
+	double radius = state.radius[i];
+	size_t id_x = 2 * i;
+	size_t id_y = id_x + 1;
+	const vector<int>& nearby = (*neighbors)[i];
+
+	for (unsigned int j = 0; j < nearby.size(); ++j)
+	{
+		const LineObstacle& obstacle = obstacles->segment(nearby[j]);
+		// are we crossing the obstacle?
+		double distance_energy = 0;
+		double g[] = { 0, 0 };
+		if (distanceEnergy(pos[id_x], pos[id_y], vNew[id_x], vNew[id_y], obstacle, radius, state.dt, distance_energy, grad != NULL ? g : NULL))
+			return false;
+
+		// the ttc energy treats the point of the obstacle closest to the agent at the start of the step as a static agent
+		Vector2D closest = obstacle.closestPoint(Vector2D(pos[id_x], pos[id_y]));
+		double ttc_energy = ttc->energy(posNew[id_x], posNew[id_y], closest.x(), closest.y(),
+			vNew[id_x], vNew[id_y], 0, 0, radius, state.dt, grad != NULL ? g : NULL);
+
+		// unlike an agent pair, the interaction belongs to agent i only, so its energy is always added
+		f += ttc_energy;
+		f += distance_energy;
+		if (grad != NULL)
+		{
+			grad[0] += g[0];
+			grad[1] += g[1];
+		}
+	}
+	return true;
+}
+
+inline bool ObstacleTerm::fieldEnergy(const EnergyState& state, int i, double& f, double* grad) const
+{
+	if (clearance[i] >= _INFTY) // no obstacle around
+		return true;
+	const double* pos = state.position;
+	const double* vNew = state.vNew;
+	const double* posNew = state.posNew;
+	const double dt = state.dt;
+	double radius = state.radius[i];
+	size_t id_x = 2 * i;
+	size_t id_y = id_x + 1;
+
+	// the agent cannot reach an obstacle if it moves less than its clearance; otherwise its path is checked exactly
+	double stepSq = (vNew[id_x] * vNew[id_x] + vNew[id_y] * vNew[id_y])*dt*dt;
+	if (stepSq >= clearance[i] * clearance[i])
+	{
+		const vector<int>& nearby = (*neighbors)[i];
+		for (size_t j = 0; j < nearby.size(); ++j)
+		{
+			double distance_energy;
+			if (distanceEnergy(pos[id_x], pos[id_y], vNew[id_x], vNew[id_y], obstacles->segment(nearby[j]), radius, dt, distance_energy, NULL))
+				return false;
+		}
+	}
+
+	// distance energy at the end of the step. The interpolated distance can be slightly off near the obstacles, so it is kept positive
+	Vector2D gradient;
+	double distance = field->distance(Vector2D(posNew[id_x], posNew[id_y]), &gradient) - radius;
+	if (distance < 1e-3)
+	{
+		distance = 1e-3;
+		gradient = Vector2D(0, 0);
+	}
+	double energy = eta / distance;
+	if (grad != NULL)
+	{
+		double scale = -eta / (distance*distance)*dt;
+		grad[0] += scale*gradient.x();
+		grad[1] += scale*gradient.y();
+	}
+
+	// ttc energy with the closest obstacle point at the start of the step, as in the exact evaluation
+	energy += ttc->energy(posNew[id_x], posNew[id_y], wallPoint[id_x], wallPoint[id_y], vNew[id_x], vNew[id_y], 0, 0, radius, dt, grad);
+	f += energy;
+	return true;
+}
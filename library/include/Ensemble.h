@@ -0,0 +1,99 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+*  @file       Ensemble.h
+*  @brief      Contains the Ensemble and EnsembleObserver classes.
+*/
+
+#pragma once
+#include "implicitEngine.h"
+#include "Scenario.h"
+
+/**
+* @brief Receives the progress of the runs of an ensemble.
+*
+* The functions are called from the worker threads, so different runs may call them concurrently.
+*/
+class EnsembleObserver
+{
+public:
+	/// Destructor
+	virtual ~EnsembleObserver() {}
+	/// Called after every step of a run. Returning false stops the run
+	virtual bool stepped(int /*run*/, const ImplicitEngine& /*engine*/) { return true; }
+	/// Called once a run has ended, right before its engine is destroyed
+	virtual void finished(int /*run*/, const ImplicitEngine& /*engine*/) {}
+};
+
+/**
+* @brief Runs many independent simulations of the same scenario concurrently in one process.
+*
+* Every run has its own engine, parameters, random seed and thread budget. The scenario is parsed once and
+* shared read-only by all runs. The runs do not share one pool of threads: every engine keeps a pool of its own
+* thread budget, since the loops of a solve are too short to be interleaved with those of other runs, so an ensemble
+* runs concurrentRuns*threadsPerRun threads in total.
+*/
+class Ensemble
+{
+public:
+	/// Constructor. The scenario must outlive the ensemble
+	Ensemble(const Scenario& scenario);
+	/// Adds a run with the given parameters and seed. Returns the index of the run
+	int addRun(const Parser& parameters, unsigned int seed);
+	/// Removes all runs, keeping the other settings
+	void clearRuns() { _runs.clear(); }
+	/// Sets how many runs execute at the same time, and how many threads each of them uses. A non-positive number of threads shares the
+	/// cores evenly among the concurrent runs. Every engine keeps its own threads, so the process runs concurrentRuns*threadsPerRun threads
+	void setConcurrency(int concurrentRuns, int threadsPerRun);
+	/// Sets the time step of all runs
+	void setTimeStep(double dt) { _dt = dt; }
+	/// Sets the maximum number of simulation steps of all runs
+	void setMaxSteps(int steps) { _maxSteps = steps; }
+	/// Returns the number of runs
+	int getNumRuns() const { return (int)_runs.size(); }
+	/// Executes all runs and blocks until they have finished
+	void run(EnsembleObserver* observer = NULL);
+
+protected:
+	/// Executes a single run on the calling thread, the given worker of the ensemble
+	void runSingle(int run, int worker, EnsembleObserver* observer);
+
+	/// The parameters of a single run
+	struct Run
+	{
+		Parser parameters;
+		unsigned int seed;
+	};
+
+	/// The shared scenario
+	const Scenario& _scenario;
+	/// The runs
+	vector<Run> _runs;
+	/// The number of runs executing at the same time
+	int _concurrentRuns;
+	/// The number of threads used by each run
+	int _threadsPerRun;
+	/// The time step of all runs
+	double _dt;
+	/// The maximum number of simulation steps of all runs
+	int _maxSteps;
+};
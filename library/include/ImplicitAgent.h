@@ -27,20 +27,36 @@
 
 #pragma once
 #include "AgentInitialParameters.h"
+#include "AgentStore.h"
+#include "Checkpoint.h"
+#include "NavigationField.h"
 #include "proximitydatabase/Proximity2D.h"
 
 /*!
 @class	ImplicitAgent
 @brief	A simple agent class
+While the agent is active, its state lives in an AgentStore and the agent is a thin view of its slot.
+Once the agent reaches its goal, its last state is copied back into the agent.
 */
 class ImplicitAgent : public ProximityDatabaseItem
 {
 public:
 	ImplicitAgent();
 	~ImplicitAgent();
-	void init(const AgentInitialParameters& initialConditions, SpatialProximityDatabase *const);
-	void update(double dt);
+	void init(const AgentInitialParameters& initialConditions, SpatialProximityDatabase *const, AgentStore *const);
+	/// Moves the agent across a step of length dt that ends at the given time, and records its path every frameDt since the agent was spawned
+	void update(double dt, double time, double frameDt);
 	void doStep(double dt);
+	/// Removes the agent from the simulation, e.g. when it reaches its goal or enters a sink. The proximity token is kept for reuse
+	void disable();
+	/// Writes the full state of the agent, including its path, to a checkpoint
+	void saveState(CheckpointWriter& output) const;
+	/// Reads the state written by saveState. The agent is left disabled, call attach to put it back in the simulation
+	void loadState(CheckpointReader& input);
+	/// Puts a restored agent back into the store, in the next free slot
+	void attach(AgentStore *const store);
+	/// Inserts a restored agent into the proximity database, allocating its token if needed
+	void insertIntoDatabase(SpatialProximityDatabase *const pd);
 
 	/// @name AbstractAgent functionality
 	//@{
@@ -49,13 +65,17 @@ public:
 	/// Returns true if the agent is active.
 	bool enabled() const { return _enabled; }
 	/// Returns the position of the agent.  
-	Vector2D position() const { return _position; }
+	Vector2D position() const { return _enabled ? _store->position(_activeid) : _position; }
 	/// Returns the velocity of the agent.  
-	Vector2D velocity() const { return _velocity; }
+	Vector2D velocity() const { return _enabled ? _store->velocity(_activeid) : _velocity; }
 	/// Returns the goals of the agent.  
 	Vector2D goal() const { return _goal; }
+	/// Returns the region the goal of the agent was drawn from; just the goal unless the agent was spawned by a source.  
+	const SpawnRegion& goalRegion() const { return _goalRegion; }
+	/// Returns the navigation field guiding the agent to its goal region, or NULL if the agent heads straight to its goal.  
+	const NavigationField* navigationField() const { return _navigation.get(); }
 	/// Returns the preferred velocity of the agent.  
-	Vector2D vPref() const { return _vPref; }
+	Vector2D vPref() const { return _enabled ? _store->vPref(_activeid) : _vPref; }
 	/// Returns the orientation of the agent.  
 	Vector2D orientation() const { return _orientation; }
 	/// Returns the preferred speed of the agent.  
@@ -68,10 +88,20 @@ public:
 	int activeID() const { return _activeid; }
 	/// Returns the group id of the agent.  
 	int gid() const { return _gid; }
+	/// Returns the simulation time at which the agent entered the simulation.  
+	double spawnTime() const { return _spawnTime; }
 	/// Sets the preferred velocity of the agent to a specific value.	
-	void setPreferredVelocity(const Vector2D& v){_vPref = v;}
+	void setPreferredVelocity(const Vector2D& v) { if (_enabled) _store->setVPref(_activeid, v); else _vPref = v; }
 	/// Sets the  velocity of the agent to a specific value.	
-	void setVelocity(const Vector2D& v) { _velocity = v; }
+	void setVelocity(const Vector2D& v) { if (_enabled) _store->setVelocity(_activeid, v); else _velocity = v; }
+	/// Sets the preferred velocity of the next step, which is otherwise computed from the goal. The agent still leaves once it reaches its goal	
+	void steer(const Vector2D& v) { setPreferredVelocity(v); _steered = true; }
+	/// Sends the agent to a new goal. Its navigation field is looked up again for the new goal	
+	void setGoal(const Vector2D& goal);
+	/// Sets the region the goal of the agent was drawn from. Agents with the same goal region share their navigation field	
+	void setGoalRegion(const SpawnRegion& region) { _goalRegion = region; }
+	/// Sets the navigation field guiding the agent to its goal region. The field is freed once no agent uses it	
+	void setNavigationField(const shared_ptr<const NavigationField>& field) { _navigation = field; }
 	/// Sets the active id of the agent to a specific value.	
 	void setActiveID(const int& id) { _activeid = id; }	
 	/// Returns the path of the agent
@@ -84,25 +114,33 @@ public:
 
 protected:
 	inline void destroy();
+	/// Copies the state of the agent out of the store, before its slot is released
+	void detach();
 			
 protected:
-	/// the preferred velocity of the character
+	/// The store holding the state of the character while it is enabled
+	AgentStore* _store;
+	/// the preferred velocity of the character. Only valid once the character is disabled
 	Vector2D _vPref;
 	/// Determine whether the charater is enabled;
 	bool _enabled;
-	/// The position of the character. 
+	/// The position of the character. Only valid once the character is disabled
 	Vector2D _position;
 	/// The goal of the character. 
 	Vector2D _goal;
+	/// The region the goal of the character was drawn from
+	SpawnRegion _goalRegion;
+	/// The navigation field towards the goal region, shared with the other characters heading there
+	shared_ptr<const NavigationField> _navigation;
 	/// The orientation of the character
 	Vector2D _orientation;
-	/// The velocity of the character
+	/// The velocity of the character. Only valid once the character is disabled
 	Vector2D _velocity;
 	/// The radius of the character.
 	double _radius;
 	/// The id of the character. 
 	int _id;
-	/// The active id of the character. Workaround to account for the fact that the crowd size can dynamically change
+	/// The active id of the character, i.e. its slot in the store. Workaround to account for the fact that the crowd size can dynamically change
 	int _activeid;
 	/// The group id of the character
 	int _gid;
@@ -112,9 +150,13 @@ protected:
 	double _prefSpeed;
 	/// The goal radius of the character
 	double _goalRadiusSq;
+	/// The simulation time at which the character entered the simulation
+	double _spawnTime;
+	/// True if the preferred velocity of the next step has been set from outside
+	bool _steered;
 	/// a pointer to this interface object for the proximity database
 	ProximityToken* _proximityToken;	
-	/// path and orientations
+	/// path and orientations, sampled every frame since the character was spawned
 	vector<Vector2D> _path;
 	vector<Vector2D> _orientations;
 };
\ No newline at end of file
@@ -0,0 +1,125 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+*  @file       ImplicitCrowdsC.h
+*  @brief      A C interface to the ImplicitEngine, for embedding the simulator e.g. in a game loop.
+*
+*  An engine is handled through an opaque pointer. The state of all agents is copied in bulk into caller-provided
+*  buffers: the values of the agent with id first+i are written at byte offset i*stride, so they can go straight into
+*  an array of structs or a vertex buffer. A stride of 0 means packed values.
+*
+*  After every step the engine publishes a snapshot of the agents, and the bulk setters are queued until the next step.
+*  Hence the functions marked as thread-safe can be called from any thread, e.g. a render thread, even while ic_step
+*  runs on the simulation thread; they never see a half-finished step. All other functions have to be called from a
+*  single thread.
+*/
+
+#pragma once
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(IMPLICIT_C_API_EXPORTS)
+#define IC_API __declspec(dllexport)
+#elif defined(_WIN32) && defined(IMPLICIT_C_API_IMPORTS)
+#define IC_API __declspec(dllimport)
+#else
+#define IC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// An engine
+typedef struct ic_engine ic_engine;
+
+/// The result of the functions that can fail
+typedef enum ic_status
+{
+	IC_OK = 0,
+	/// A file could not be read
+	IC_ERROR_FILE = -1,
+	/// An argument is out of range
+	IC_ERROR_ARGUMENT = -2
+} ic_status;
+
+/// @name Setup, from the simulation thread
+//@{
+/// Creates an engine for an environment of the given extent, whose neighbor grid has the given number of cells
+IC_API ic_engine* ic_create(double width, double height, int xCells, int yCells);
+/// Creates an engine with the environment, agents, sources, sinks and obstacles of a scenario file. Returns NULL if the file cannot be read
+IC_API ic_engine* ic_create_from_scenario(const char* fileName);
+/// Destroys an engine
+IC_API void ic_destroy(ic_engine* engine);
+/// Reads the parameters of a parameters file such as implicit.ini
+IC_API ic_status ic_load_parameters(ic_engine* engine, const char* fileName);
+/// Sets a single parameter by its name in the parameters file
+IC_API ic_status ic_set_parameter(ic_engine* engine, const char* key, const char* value);
+/// Sets the time step, 0.1 by default
+IC_API void ic_set_time_step(ic_engine* engine, double dt);
+/// Sets the number of steps after which the simulation ends; unlimited by default
+IC_API void ic_set_max_steps(ic_engine* engine, int steps);
+/// Adds count agents. The positions and goals are pairs of doubles, and the preferred speeds and radii single doubles, or NULL for
+/// 1.3 m/s and 0.24 m. The ids of the agents are written to ids if it is not NULL
+IC_API ic_status ic_add_agents(ic_engine* engine, int count, const double* positions, ptrdiff_t positionStride, const double* goals, ptrdiff_t goalStride,
+	const double* prefSpeeds, ptrdiff_t prefSpeedStride, const double* radii, ptrdiff_t radiusStride, int* ids);
+/// Adds a line segment (two vertices) or a closed polygon given by count pairs of doubles
+IC_API ic_status ic_add_obstacle(ic_engine* engine, int count, const double* vertices, ptrdiff_t stride);
+//@}
+
+/// @name Simulation, from the simulation thread
+//@{
+/// Applies the queued preferred velocities and goals, takes a step and publishes the new state. Returns 0 once the simulation has ended
+IC_API int ic_step(ic_engine* engine);
+//@}
+
+/// @name Thread-safe access to the state published by the last step
+//@{
+/// Returns the simulation time
+IC_API double ic_get_time(const ic_engine* engine);
+/// Returns the number of steps taken
+IC_API int ic_get_iteration(const ic_engine* engine);
+/// Returns the number of agents, i.e. one more than the largest id
+IC_API int ic_get_num_agents(const ic_engine* engine);
+/// Returns the number of agents that have not left the simulation yet
+IC_API int ic_get_num_active_agents(const ic_engine* engine);
+/// Returns the largest velocity change of the last full solver iteration of the last step, below eps_x if the step converged (see solveBudget)
+IC_API double ic_get_convergence_gap(const ic_engine* engine);
+/// Returns 1 if the time budget of the last step stopped its solver, and 0 otherwise
+IC_API int ic_get_hit_deadline(const ic_engine* engine);
+/// Copies the positions (pairs of doubles) of the agents first to first+count-1. Returns the number of agents copied
+IC_API int ic_get_positions(const ic_engine* engine, int first, int count, double* positions, ptrdiff_t stride);
+/// Copies the velocities (pairs of doubles) of the agents first to first+count-1. Returns the number of agents copied
+IC_API int ic_get_velocities(const ic_engine* engine, int first, int count, double* velocities, ptrdiff_t stride);
+/// Copies the orientations (pairs of doubles) of the agents first to first+count-1. Returns the number of agents copied
+IC_API int ic_get_orientations(const ic_engine* engine, int first, int count, double* orientations, ptrdiff_t stride);
+/// Copies whether the agents first to first+count-1 are still in the simulation (1) or have left it (0). Returns the number of agents copied
+IC_API int ic_get_active(const ic_engine* engine, int first, int count, unsigned char* active, ptrdiff_t stride);
+/// Sets the preferred velocities (pairs of doubles) of the next step of the agents first to first+count-1, instead of heading to their goals.
+/// Returns the number of agents set
+IC_API int ic_set_preferred_velocities(ic_engine* engine, int first, int count, const double* velocities, ptrdiff_t stride);
+/// Sends the agents first to first+count-1 to new goals (pairs of doubles) from the next step on. Returns the number of agents set
+IC_API int ic_set_goals(ic_engine* engine, int first, int count, const double* goals, ptrdiff_t stride);
+//@}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,78 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+/*!
+*  @file       NavigationField.h
+*  @brief      Contains the NavigationField class.
+*/
+
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "Obstacles.h"
+#include "SpawnSource.h"
+#include "TaskPool.h"
+using namespace std;
+
+/**
+* @brief The direction of the shortest path towards a goal region around the obstacles, sampled on a regular grid.
+*
+* The travel distance to the goal is computed once with the fast marching method, on the samples that are further than a
+* clearance from all obstacles, and its descent direction is stored per sample. All agents heading to the same goal region
+* share the field. Fields are immutable, so engines with the same obstacles and goals share them as well, and a field is freed
+* once its last user releases it.
+*/
+class NavigationField
+{
+public:
+	/// Returns the field towards the goal region, covering the given extent. The field is shared with the other users of the same geometry and goal
+	/// in this process, otherwise it is read from the cache directory, or computed on the threads of the pool and written to it. An empty directory
+	/// disables the disk cache. Callers asking for a field that is being computed wait for it, while fields of other geometries are computed concurrently
+	static shared_ptr<const NavigationField> obtain(const ObstacleGrid& obstacles, const SpawnRegion& goal, const SpawnRegion& extent,
+		double cellSize, double clearance, const string& cacheDirectory, TaskPool& pool);
+	/// Returns the unit direction of the shortest path at p, or zero if p is inside the goal region, unreachable or outside the field
+	Vector2D direction(const Vector2D& p) const;
+	/// Returns the travel distance to the goal region from the sample closest to p, or a negative value if it is unreachable or outside the field
+	double travelDistance(const Vector2D& p) const;
+
+protected:
+	NavigationField();
+	/// Marches the travel distance outwards from the goal region and stores its descent direction
+	void compute(const ObstacleGrid& obstacles, const SpawnRegion& goal, const SpawnRegion& extent, double cellSize, double clearance, TaskPool& pool);
+	/// Reads a cached field, returns false if the file is missing or malformed
+	bool load(const string& fileName);
+	/// Writes the field to the cache
+	bool save(const string& fileName) const;
+	/// Hashes the obstacles, the goal and the sampling parameters
+	static unsigned long long hash(const ObstacleGrid& obstacles, const SpawnRegion& goal, const SpawnRegion& extent, double cellSize, double clearance);
+
+protected:
+	/// The position of the first sample, the spacing of the samples and their number per axis
+	Vector2D _origin;
+	double _cellSize;
+	int _xNodes, _yNodes;
+	/// The hash of the geometry and the goal
+	unsigned long long _hash;
+	/// The travel distance of every sample, negative if unreachable
+	vector<float> _distance;
+	/// The descent direction of every sample, interleaved
+	vector<float> _direction;
+};
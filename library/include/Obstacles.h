@@ -0,0 +1,97 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+/*!
+*  @file       Obstacles.h
+*  @brief      Contains the static line obstacles and the grid used to query them.
+*/
+
+#pragma once
+#include <vector>
+#include "AgentInitialParameters.h"
+using std::vector;
+
+/** 
+  * @brief A static line segment that agents cannot cross.
+  */
+struct LineObstacle {
+	/// The end points of the segment
+	Vector2D a;
+	Vector2D b;
+	/// Returns the point of the segment closest to p
+	Vector2D closestPoint(const Vector2D& p) const
+	{
+		Vector2D ab = b - a;
+		double t = (p - a).dot(ab) / ab.squaredNorm();
+		t = t < 0 ? 0 : (t > 1 ? 1 : t);
+		return a + t*ab;
+	}
+};
+
+/**
+* @brief The static obstacles of the environment, binned in a uniform grid.
+*
+* The grid is built once, after all obstacles have been added. A segment is stored in every cell it crosses, so the
+* cost of a query depends on the number of obstacles near the query point and not on the total number of obstacles.
+* Queries do not modify the grid and can be run concurrently.
+*/
+class ObstacleGrid
+{
+public:
+	/// Default constructor
+	ObstacleGrid();
+	/// Adds a line segment. Degenerate segments are ignored
+	void addSegment(const Vector2D& a, const Vector2D& b);
+	/// Adds a closed polygon, as the segments between consecutive vertices
+	void addPolygon(const vector<Vector2D>& vertices);
+	/// Bins the segments in cells of the given size. The cells are enlarged if the grid would get too large
+	void build(double cellSize);
+	/// Replaces the results with the indices of the segments within the given distance from the center, in increasing order
+	void query(const Vector2D& center, double radius, vector<int>& results) const;
+
+	/// @name Get functionality
+	//@{
+	/// Returns true if there are no obstacles
+	bool empty() const { return _segments.empty(); }
+	/// Returns true if the grid is up to date with the segments
+	bool isBuilt() const { return _built; }
+	/// Returns the segment with the given index
+	const LineObstacle& segment(int i) const { return _segments[i]; }
+	/// Returns all segments
+	const vector<LineObstacle>& segments() const { return _segments; }
+	//@}
+
+protected:
+	/// Collects the cells that the segment may cross, testing each cell against the segment conservatively
+	void cellsOf(const LineObstacle& segment, vector<int>& cells) const;
+
+protected:
+	/// The segments
+	vector<LineObstacle> _segments;
+	/// Determine whether the grid is up to date
+	bool _built;
+	/// The bottom-left corner of the grid, the size of its cells and the number of cells per axis
+	Vector2D _origin;
+	double _cellSize;
+	int _xCells, _yCells;
+	/// The segments of cell c are _cellItems[_cellStart[c]] to _cellItems[_cellStart[c+1]-1]
+	vector<int> _cellStart;
+	vector<int> _cellItems;
+};
@@ -47,6 +47,10 @@ class Parser
 	bool getDoubleValue(const string& key, double& value) const;
 	bool getBoolValue(const string& key, bool& value) const;
 	bool registerParameters(const string& fileName);
+	/// Sets the value of a parameter, overriding the value read from a file if any
+	void setValue(const string& key, const string& value);
+	/// Sets the value of a numerical parameter, keeping its full precision
+	void setValue(const string& key, double value);
 
 protected:
 	vector<Parameter> args;	
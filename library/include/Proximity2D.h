@@ -21,7 +21,7 @@
 #pragma once
 
 #include <vector>
-#include "lq2D.h"
+#include "lq2d.h"
 #include "ProximityDatabaseItem.h" 
 
 
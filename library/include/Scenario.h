@@ -0,0 +1,78 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+*  @file       Scenario.h
+*  @brief      Contains the Scenario class.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include "SpawnSource.h"
+using namespace std;
+
+class ImplicitEngine;
+
+/**
+* @brief A scenario read from a file: the extent of the environment, the initial agents, and the optional sources, sinks and obstacles.
+*
+* A scenario is parsed once and can then populate any number of engines. It is not modified by them, so it can be
+* shared between engines running concurrently.
+*/
+class Scenario
+{
+public:
+	/// Default constructor
+	Scenario();
+	/// Parses a scenario file. Returns false if the file cannot be read or is malformed
+	bool load(const string& fileName);
+	/// Initializes the engine with the extent of the environment and adds the agents, sources, sinks and obstacles to it
+	void populate(ImplicitEngine& engine) const;
+
+	/// @name Get functionality
+	//@{
+	double xMin() const { return _xMin; }
+	double xMax() const { return _xMax; }
+	double yMin() const { return _yMin; }
+	double yMax() const { return _yMax; }
+	/// Returns the initial agents
+	const vector<AgentInitialParameters>& getAgents() const { return _agents; }
+	/// Returns the sources
+	const vector<SpawnSource>& getSources() const { return _sources; }
+	/// Returns the sinks
+	const vector<SpawnRegion>& getSinks() const { return _sinks; }
+	/// Returns the vertices of the obstacles
+	const vector<vector<Vector2D>>& getObstacles() const { return _obstacles; }
+	//@}
+
+protected:
+	/// The range of the environment
+	double _xMin, _xMax, _yMin, _yMax;
+	/// The initial agents
+	vector<AgentInitialParameters> _agents;
+	/// The sources
+	vector<SpawnSource> _sources;
+	/// The sinks
+	vector<SpawnRegion> _sinks;
+	/// The obstacles, as line segments (two vertices) or closed polygons
+	vector<vector<Vector2D>> _obstacles;
+};
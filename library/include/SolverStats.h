@@ -0,0 +1,79 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+*  @file       SolverStats.h
+*  @brief      Contains the per-step statistics of the implicit solver.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+using namespace std;
+
+/// Statistics are only gathered when IMPLICIT_STATS is defined, otherwise the statements compile to nothing
+#ifdef IMPLICIT_STATS
+#define STATS(statement) statement
+#else
+#define STATS(statement)
+#endif
+
+/** 
+  * @brief Statistics of a single simulation step.
+  */
+struct StepStats {
+	/// The simulation step, the simulation time at its start, and its time step
+	int step;
+	double time;
+	double timeStep;
+	/// The number of active agents, the number of those advanced outside the solver, the number of those that took sub-steps, and the number of neighboring pairs considered by the energy
+	int activeAgents;
+	int isolatedAgents;
+	int fineAgents;
+	int pairs;
+	/// The number of solver iterations, the number of restarts of the search direction (e.g. because of a bad Hessian estimation) or of the momentum,
+	/// and the number of iterations that took the extrapolated or mixed iterate of an accelerated optimizer
+	int iterations;
+	int restarts;
+	int acceleratedSteps;
+	/// The number of energy evaluations and backtracks performed by the line search
+	int lineSearchEvaluations;
+	int backtracks;
+	/// The number of energy evaluations that were infeasible, i.e. returned an infinite energy
+	int infeasibleEvaluations;
+	/// The norm of the last gradient of the step
+	double gradientNorm;
+	/// The largest velocity change of the last full solver iteration, over the solves of the step, which is below eps_x once converged, and
+	/// whether a solve was stopped by the deadline of the step
+	double convergenceGap;
+	int deadlineHit;
+	/// Wall time in seconds spent computing the preferred velocities, searching the neighbors, solving, and updating the agents
+	double doStepTime;
+	double neighborTime;
+	double solveTime;
+	double updateTime;
+
+	/// Resets all counters for the given step
+	void reset(int step, double time);
+};
+
+/// Writes the statistics to a file, as JSON if the file name ends with .json and as CSV otherwise. Returns false if the file cannot be written
+bool writeStats(const vector<StepStats>& stats, const string& fileName);
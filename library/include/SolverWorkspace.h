@@ -0,0 +1,88 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+/*!
+*  @file       SolverWorkspace.h
+*  @brief      Contains the SolverWorkspace class, the memory reused by the implicit solver from step to step.
+*/
+
+#pragma once
+#include "AgentInitialParameters.h"
+
+typedef Eigen::Map<VectorXd> VectorView;
+typedef Eigen::Map<MatrixXd> MatrixView;
+
+/// The optimization methods of the implicit solver. All of them search along their direction with the same line search, starting from zero velocities
+enum Optimizer { 
+	LBFGSOptimizer, ///< Limited-memory BFGS
+	NesterovOptimizer, ///< L-BFGS steps from a point extrapolated along the last step, when that point lowers the energy
+	AndersonOptimizer, ///< L-BFGS steps mixed with the previous ones by Anderson acceleration, when the mix lowers the energy
+	ConjugateGradientOptimizer, ///< Nonlinear conjugate gradient (Polak-Ribiere+)
+	AcceleratedGradientOptimizer ///< Gradient descent with Nesterov momentum, restarted when the momentum points uphill
+};
+
+/**
+* @brief The vectors of the implicit solver, carved out of a single buffer that only grows.
+*
+* The views have the size of the current problem, while the buffer keeps the capacity of the largest problem so far, so
+* steps whose problem fits allocate nothing here. The solver itself only works in these views, which debug builds assert by
+* counting the allocations of Eigen objects during every solve; other containers of the step are not counted.
+*/
+class SolverWorkspace
+{
+public:
+	/// Constructor. The workspace starts empty
+	SolverWorkspace();
+	/// Points the views to a problem of the given number of variables, L-BFGS history and Anderson history, growing the buffer by half again if
+	/// it is too small. The contents of the views are undefined afterwards
+	void resize(int noVars, int window, int mixingWindow = 0);
+	/// Returns the number of variables that fit without growing
+	int capacity() const { return _capacity; }
+	/// Returns the number of times the buffer has been allocated
+	int allocations() const { return _allocations; }
+
+	/// The velocities solved for, and the positions they lead to
+	VectorView vNew, posNew;
+	/// The gradient, the L-BFGS direction, and the previous iterate and gradient
+	VectorView grad, q, xOld, gradOld;
+	/// The last step and gradient change, the trial point of the line search, and the scale of the variables in it
+	VectorView sTemp, yTemp, trial, scale;
+	/// The change of the iterate over the last steps, along which the accelerated optimizers extrapolate
+	VectorView momentum;
+	/// The velocities of the lowest energy evaluated so far, kept when the solve has a deadline
+	VectorView best;
+	/// The L-BFGS history of steps and gradient changes, one column per pair
+	MatrixView s, y;
+	/// The coefficients of the two-loop recursion
+	VectorXd alpha, rho;
+	/// The last L-BFGS iterate and step, and the history of their changes for Anderson acceleration, one column per pair. Empty without mixing
+	VectorView gLast, fLast;
+	MatrixView dG, dF;
+	/// The normal equations of the Anderson mixing, and their solution
+	MatrixXd normal;
+	VectorXd gamma;
+
+protected:
+	/// The number of vectors of the size of the problem, counting the history matrices column by column
+	static const int _noVectors = 12;
+	VectorXd _buffer;
+	int _capacity, _window, _mixingWindow;
+	int _allocations;
+};
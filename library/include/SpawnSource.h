@@ -0,0 +1,64 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+ *  @file       SpawnSource.h
+ *  @brief      Contains the SpawnRegion and SpawnSource structs.
+ */
+
+#pragma once
+#include "AgentInitialParameters.h"
+
+/** 
+  * @brief An axis-aligned rectangular region of the environment.
+  */
+struct SpawnRegion {
+	/// The bottom-left corner of the region. 
+	Vector2D min;
+	/// The top-right corner of the region. 
+	Vector2D max;
+	/// Returns true if the point lies inside the region.
+	bool contains(const Vector2D& p) const { return p.x() >= min.x() && p.x() <= max.x() && p.y() >= min.y() && p.y() <= max.y(); }
+};
+
+/** 
+  * @brief A source that injects agents into the simulation at a given rate.
+  */
+struct SpawnSource {
+	/// The simulation time at which the source starts spawning agents. 
+	double startTime;
+	/// The simulation time at which the source stops spawning agents. 
+	double endTime;
+	/// The number of agents spawned per second.
+	double rate;
+	/// The region where agents are spawned, uniformly at random.
+	SpawnRegion region;
+	/// The region where the goals of the spawned agents are drawn from, uniformly at random.
+	SpawnRegion goalRegion;
+	/// The preferred speed of the spawned agents. 
+	double prefSpeed;
+	/// The radius of the spawned agents.
+	double radius;
+	/// The goal radius of the spawned agents.
+	double goalRadius;
+	/// The group id of the spawned agents
+	int gid;
+};
@@ -0,0 +1,129 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+/*!
+*  @file       TaskPool.h
+*  @brief      Contains the TaskPool class, the threads that run the parallel loops of an engine.
+*/
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/**
+* @brief A persistent set of threads that execute the chunks of parallel loops, stealing chunks from each other.
+*
+* The chunks of a loop are dealt to the threads in contiguous ranges. A thread that has run out of chunks takes the upper
+* half of the range of another thread, so uneven chunks even out without any central queue. The calling thread takes part in
+* every loop, so a pool of n threads starts n - 1 workers and a pool of one thread runs the loops inline.
+* Between loops the workers spin for a short while before they sleep, so the many short loops of a solve neither fork threads
+* nor wait for sleeping ones. Every engine owns a pool of its own size, so engines running side by side do not share or
+* multiply their threads.
+*
+* Pinned threads stay on one core each, filling the cores of a NUMA node before those of the next one, so a loop that deals
+* the same ranges to the threads without stealing touches the same memory from the same node every time. The calling thread is
+* pinned by the first loop it starts and gets its former affinity back when the pool is resized or destroyed from it. Pools that
+* run side by side take disjoint cores when each starts at its own first core.
+*/
+class TaskPool
+{
+public:
+	/// Constructor. The pool starts with the calling thread only
+	TaskPool();
+	/// Destructor. Stops the workers
+	~TaskPool();
+	/// Sets the number of threads, including the calling thread, and whether they are pinned to cores. Thread t is pinned to the core
+	/// firstCore + t of the cores of the process, ordered node by node. Must not be called while a loop runs
+	void resize(int threads, bool pinned = false, int firstCore = 0);
+	/// Returns the number of threads, including the calling thread
+	int size() const { return (int)_workers.size() + 1; }
+	/// Calls task(chunk, thread) for every chunk in [0, noChunks), where thread is the index of the thread running it, below size(), and
+	/// returns once all chunks are done. Without stealing, thread t runs the chunks from t*noChunks/size() to (t+1)*noChunks/size().
+	/// Must not be called from inside a task
+	template <typename Task>
+	void run(int noChunks, const Task& task, bool steal = true) { runTask(noChunks, &invoke<Task>, &task, steal); }
+	/// Calls body(i) for every i in [0, count), in a few chunks per thread
+	template <typename Body>
+	void forEach(int count, const Body& body, bool steal = true)
+	{
+		const int noChunks = min(count, 4 * size());
+		run(noChunks, [&](int chunk, int)
+		{
+			const int end = (int)((long long)(chunk + 1)*count / noChunks);
+			for (int i = (int)((long long)chunk*count / noChunks); i < end; ++i)
+				body(i);
+		}, steal);
+	}
+
+protected:
+	/// Tasks are called through a plain function, so that starting a loop neither allocates nor copies the task
+	typedef void(*TaskFunction)(const void* task, int chunk, int thread);
+	template <typename Task>
+	static void invoke(const void* task, int chunk, int thread) { (*static_cast<const Task*>(task))(chunk, thread); }
+	/// Runs the loop of a task
+	void runTask(int noChunks, TaskFunction function, const void* task, bool steal);
+	/// The loop of a worker thread, which has seen the loops up to the given generation
+	void work(int thread, unsigned int generation);
+	/// Runs the chunks of the thread, then steals from the others until no chunk is left if stealing is allowed
+	void execute(int thread);
+	/// Takes the next chunk of the range of the thread
+	bool pop(int thread, int& chunk);
+	/// Takes a chunk, and the rest of the stolen range, from another thread
+	bool steal(int thread, int& chunk);
+	/// Returns the core of a pinned thread
+	int core(int thread) const { return _cores[(_firstCore + thread) % _cores.size()]; }
+	/// Gives the pinned calling thread its former affinity back, if it is the current thread
+	void unpinCaller();
+
+	/// The chunks left to a thread, with the first chunk in the low and the end in the high half of the word, so that
+	/// the owner and the thieves update it with a single compare-and-swap. Padded to a cache line
+	struct Range
+	{
+		std::atomic<unsigned long long> chunks;
+		char padding[64 - sizeof(std::atomic<unsigned long long>)];
+	};
+	static unsigned long long pack(unsigned int begin, unsigned int end) { return (unsigned long long)end << 32 | begin; }
+
+	vector<std::thread> _workers;
+	unique_ptr<Range[]> _ranges;
+	/// The task of the current loop, and whether its chunks can be stolen
+	TaskFunction _function;
+	const void* _task;
+	bool _steal;
+	/// The cores of the process, or empty if the threads are not pinned, and the index of the core of the calling thread
+	vector<int> _cores;
+	int _firstCore;
+	/// The calling thread that was pinned, and the cores it could run on before
+	std::thread::id _pinnedCaller;
+	vector<int> _callerCores;
+	/// Incremented to start a loop, and the number of workers that have not finished it
+	std::atomic<unsigned int> _generation;
+	std::atomic<int> _busy;
+	/// Tells the workers to exit
+	std::atomic<bool> _stop;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+};
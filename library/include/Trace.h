@@ -0,0 +1,81 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+*  @file       Trace.h
+*  @brief      Contains the Trace and TraceScope classes, which record a timeline in the Chrome trace format.
+*/
+
+#pragma once
+#include <string>
+using namespace std;
+
+/// Tracing is only compiled in when IMPLICIT_TRACE is defined, otherwise the macros compile to nothing
+#ifdef IMPLICIT_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(_traceScope, __LINE__)(name)
+#define TRACE(statement) statement
+#else
+#define TRACE_SCOPE(name)
+#define TRACE(statement)
+#endif
+
+/**
+* @brief A timeline of named spans per thread, written as a Chrome trace JSON file that can be opened in Perfetto or chrome://tracing.
+*
+* Every thread records into its own buffer without locking. Full chunks of a buffer are handed over to the writer,
+* so that flush() can be called at any time, e.g. periodically between simulation steps.
+*/
+class Trace
+{
+public:
+	/// Starts recording, writing to the given file. Returns false if the file cannot be written
+	static bool start(const string& fileName);
+	/// Writes the chunks that are complete. Can be called while other threads are recording
+	static void flush();
+	/// Writes all remaining events and closes the file. Must be called when no thread is recording
+	static void stop();
+	/// Returns true while recording
+	static bool enabled();
+	/// Returns the time in microseconds since recording started
+	static double now();
+	/// Records a complete span of the calling thread, with an optional integer argument
+	static void record(const char* name, double start, double end, const char* argName, long long arg);
+};
+
+/**
+* @brief Records a span from its construction to its destruction. The name must be a string literal.
+*/
+class TraceScope
+{
+public:
+	TraceScope(const char* name) : _name(name), _argName(NULL), _arg(0) { _start = Trace::enabled() ? Trace::now() : -1; }
+	~TraceScope() { if (_start >= 0 && Trace::enabled()) Trace::record(_name, _start, Trace::now(), _argName, _arg); }
+	/// Attaches an integer argument to the span, e.g. the amount of work it did
+	void setArg(const char* name, long long value) { _argName = name; _arg = value; }
+
+protected:
+	const char* _name;
+	const char* _argName;
+	long long _arg;
+	double _start;
+};
@@ -39,7 +39,24 @@
 
 #pragma once
 #include "ImplicitAgent.h"
+#include "SpawnSource.h"
+#include "Obstacles.h"
+#include "DistanceField.h"
+#include "NavigationField.h"
+#include "SolverStats.h"
 #include "Parser.h"
+#include "Checkpoint.h"
+#include "DomainDecomposition.h"
+#include "EnergyTerms.h"
+#include "TaskPool.h"
+#include "SolverWorkspace.h"
+#include <random>
+#include <thread>
+#include <map>
+#include <array>
+/// The terms of the implicit energy, fused into a single pass over the agents and their neighbors. New terms are added to this list
+typedef EnergyModel<AccelerationTerm, GoalTerm, ObstacleTerm, DistanceTerm, TtcTerm> ImplicitEnergy;
+
 template <typename T>
 using Vector = Eigen::Matrix<T, Eigen::Dynamic, 1>;
 
@@ -61,31 +78,135 @@ class ImplicitEngine
 	bool endSimulation();
 	/// Draw/animate functionality using Callisto
 	void draw();
-	/// Add a new agent to the simulation given its parameters
+	/// Add a new agent to the simulation given its parameters. Recycles an agent that has left the simulation if possible
 	void addAgent(AgentInitialParameters& parameters);
+	/// Add a source that spawns agents while the simulation runs
+	void addSource(const SpawnSource& source);
+	/// Add a sink, i.e. a region that removes the agents entering it
+	void addSink(const SpawnRegion& sink) { _sinks.push_back(sink); }
+	/// Add a static obstacle given its vertices: a line segment for two vertices, or a closed polygon for more
+	void addObstacle(const vector<Vector2D>& vertices);
 	/// Read parameters from the Parser where they have been registered
 	void readParameters(const Parser& parser);
+	/// Saves the full state of the engine to a binary checkpoint. The state is copied right away and written by a background thread, so the simulation can continue meanwhile
+	void saveCheckpoint(const string& fileName);
+	/// Waits until the last checkpoint has been written. Returns false if writing it failed
+	bool waitForCheckpoint();
+	/// Restores the state saved by saveCheckpoint. Has to be called on an engine without agents, instead of init. Returns false if the checkpoint cannot be read
+	bool loadCheckpoint(const string& fileName);
+#ifdef IMPLICIT_MPI
+	/// Splits the world into slabs, one per process of the communicator, and keeps the agents of the slab of this process only. Every process has to set up
+	/// the same scenario and parameters first. The slabs are balanced again every balanceInterval steps. Sources, multi-rate stepping and checkpoints are not available in distributed runs
+	void distribute(MPI_Comm comm = MPI_COMM_WORLD, int balanceInterval = 50);
+	/// Copies all agents, with their paths, to the given process, e.g. to draw or save them once the simulation has ended. Collective
+	void gatherAgents(int root = 0);
+	/// Returns the decomposition of the world of a distributed run, or NULL
+	const DomainDecomposition* getDomainDecomposition() const { return _domain; }
+#endif
 
 	/// @name Get/Set functionality
 	//@{
-	/// Returns the list of agents in the simulation. 
+	/// Returns the list of agents in the simulation, indexed by their ids. In a distributed run, the agents owned by other processes are NULL
 	const vector<ImplicitAgent*> & getAgents() const{ return _agents; }
+	/// Returns the static obstacles. 
+	const ObstacleGrid& getObstacles() const { return _obstacles; }
+	/// Evaluates the obstacle energy with a distance field sampled every cellSize, cached in the given directory. A non-positive cell size evaluates the obstacles exactly
+	void setDistanceField(double cellSize, const string& cacheDirectory = "") { _distanceFieldCellSize = cellSize; _distanceFieldCache = cacheDirectory; }
+	/// Guides the agents around the obstacles with navigation fields sampled every cellSize, avoiding the obstacles by the given clearance and cached
+	/// in the given directory. A field is computed once per goal region. A non-positive cell size sends the agents straight to their goals
+	void setNavigationFields(double cellSize, double clearance, const string& cacheDirectory = "") { _navigationCellSize = cellSize; _navigationClearance = clearance; _navigationCache = cacheDirectory; }
+	/// Returns the distance field of the obstacles, or NULL if the obstacles are evaluated exactly or the field has not been baked yet
+	const DistanceField* getDistanceField() const { return _distanceField.get(); }
+	/// Returns the structure-of-arrays state of the active agents. 
+	const AgentStore& getAgentStore() const { return _store; }
 	///Returns the corresponding agent given its id
 	ImplicitAgent* getAgent(int id) const { return _agents[id]; }
 	/// Returns the time step of the simulation. 
 	double getTimeStep() const { return _dt; }
 	/// Sets the time step of the simulation.
 	void setTimeStep(double dt) { _dt = dt; }
+	/// Returns the interval at which the paths of the agents are sampled. Equal to the first time step unless set
+	double getFrameStep() const { return _frameDt > 0 ? _frameDt : _dt; }
+	/// Sets the interval at which the paths of the agents are sampled, independently of the time step. Has to be set before the first step
+	void setFrameStep(double frameDt) { _frameDt = frameDt; }
+	/// Returns true if the time step adapts to the difficulty of the problem.
+	bool getAdaptiveTimeStep() const { return _adaptiveTimeStep; }
+	/// Lets the time step adapt between the given bounds, so that the solver spends as few iterations as possible per simulated second.
+	/// The step may still drop below the minimum to keep the fastest agent within a quarter of the neighbor distance per step
+	void setAdaptiveTimeStep(bool adaptive, double minTimeStep = 0.05, double maxTimeStep = 0.5)
+	{
+		_adaptiveTimeStep = adaptive; _minTimeStep = minTimeStep; _maxTimeStep = maxTimeStep;
+	}
 	/// Returns the number of simulations steps. 
 	int getMaxSteps() const { return _maxSteps; }
 	/// Sets the maximum number of simulation steps.
 	void setMaxSteps(int steps) { _maxSteps = steps; }
+	/// Returns the seed of the random generator of the engine. 
+	unsigned int getSeed() const { return _seed; }
+	/// Sets and reseeds the random generator of the engine. Engines do not share any random state
+	void setSeed(unsigned int seed);
+	/// Returns the number of threads used by the engine. 
+	int getNumThreads() const { return _max_threads; }
+	/// Sets the number of threads used by the engine; a non-positive value uses all available cores. In NUMA mode the threads are
+	/// pinned to the cores from firstCore on, so that engines running side by side can be given disjoint cores
+	void setNumThreads(int threads, int firstCore = 0);
+	/// Returns true if the results do not depend on the number of threads.
+	bool isDeterministic() const { return _deterministic; }
+	/// Makes the results bit-for-bit identical for any number of threads, at a small cost in parallel efficiency
+	void setDeterministic(bool deterministic) { _deterministic = deterministic; }
+	/// Returns true if the agents are placed in memory for the NUMA nodes of the threads.
+	bool getNumaAware() const { return _numaAware; }
+	/// Pins the threads to cores node by node, gives each thread a compact region of the agents along the spatial order (Hilbert unless set), and lets it touch their state first so
+	/// that its pages are allocated on its node. With hugePages, the state is also backed by huge pages where the system supports it.
+	/// Meant for a single large crowd per process; the layout of the agent store changes between steps
+	void setNumaAware(bool numaAware, bool hugePages = false) { _numaAware = numaAware; _hugePages = hugePages; }
+	/// Returns the order in which the agents are kept in memory.
+	SpatialOrder getSpatialOrder() const { return _spatialOrder; }
+	/// Sorts the agents along the given space-filling curve every interval steps, so that neighbors in the world are mostly neighbors in memory.
+	/// The active ids of the agents change with the sort
+	void setSpatialOrder(SpatialOrder order, int interval = 20) { _spatialOrder = order; _reorderInterval = max(interval, 1); }
+	/// Returns the optimization method of the implicit solver.
+	Optimizer getOptimizer() const { return _optimizer; }
+	/// Sets the optimization method of the implicit solver. All methods find the same velocities up to the stopping criteria, but their speed depends on the crowd
+	void setOptimizer(Optimizer optimizer) { _optimizer = optimizer; }
+	/// Returns the time budget of a step in milliseconds, or 0 if the solver runs until it converges.
+	double getSolveBudget() const { return _solveBudget; }
+	/// Stops the solver once a step has taken the given number of milliseconds, keeping the velocities of the lowest energy found so far. As the
+	/// solver starts from rest and the energy is infinite for colliding velocities, these are collision-free. 0 lets the solver run until it converges
+	void setSolveBudget(double milliseconds) { _solveBudget = max(milliseconds, 0.0); }
+	/// Returns the largest velocity change of the last full solver iteration of the last step, which is below eps_x if the solves converged, or
+	/// infinite if a deadline left no time for a single iteration.
+	double getConvergenceGap() const { return _convergenceGap; }
+	/// Returns true if the deadline of the last step stopped the solver.
+	bool hitDeadline() const { return _hitDeadline; }
+	/// Returns true if agents without neighbors are advanced outside the implicit solver.
+	bool getLevelOfDetail() const { return _levelOfDetail; }
+	/// Sets whether agents without neighbors or obstacles within the neighbor distance are advanced in closed form instead of joining the implicit solver
+	void setLevelOfDetail(bool levelOfDetail) { _levelOfDetail = levelOfDetail; }
+	/// Returns the number of sub-steps per time step taken by the agents in dense regions, or 1 if all agents take the same step.
+	int getMultiRate() const { return _multiRate; }
+	/// Lets the agents with at least the given number of neighbors, and their neighbors, take the given number of sub-steps per time step, while the rest of the crowd takes a single step
+	void setMultiRate(int substeps, int denseNeighbors = 8) { _multiRate = max(substeps, 1); _denseNeighbors = denseNeighbors; }
 	///  Returns the global time of the simulation. Initially this time is set to zero.  
 	double getGlobalTime() const { return _globalTime; }
 	/// Returns the number of agents in the simulation. 
 	int getNumAgents() const { return _noAgents; }
+	/// Sets whether agents that leave the simulation are reused for new agents. Their paths are lost when they are reused
+	void setAgentRecycling(bool recycle) { _recycleAgents = recycle; }
+	/// Returns the number of agents that have left the simulation, i.e. reached their goals or entered a sink, over all processes of a distributed run. 
+	int getNumArrivedAgents() const { return _noArrived; }
+	/// Returns the number of agents that have not reached their goals yet. 
+	int getNumActiveAgents() const { return _store.size(); }
+	/// Makes room for the given number of active agents, so that the arrays of the agent store do not move until they are exceeded
+	void reserveAgents(int count) { _store.reserve(count); }
+	/// Returns the most agents that the sources can spawn in the next step
+	int getMaxSpawns() const;
 	/// Returns the current simulation step. 
 	int getIterationNumber() const { return _iteration; }
+	/// Returns the statistics of the last step. Only gathered when compiled with IMPLICIT_STATS
+	const StepStats& getStepStats() const { return _stats; }
+	/// Returns the statistics of all steps so far. Only gathered when compiled with IMPLICIT_STATS
+	const vector<StepStats>& getStatsHistory() const { return _statsHistory; }
 	//@}
 
 protected:
@@ -93,21 +214,84 @@ protected:
 	//@{
 	/// Initializes the problem for the given current time step. Should be called before anything else
 	void initializeProblem();
+	/// Sets the time step of the next step from the difficulty of the last solve and the speed of the agents
+	void adaptTimeStep();
+	/// Moves the agents without any interaction behind the others in the store, advances them in closed form, and leaves the rest to the solver
+	void separateIsolatedAgents();
 	/// Should be called after a solution has been found for the current time step
 	void finalizeProblem();
+	/// Finds the closest obstacle point of each agent of the problem, for the lookups in the distance field
+	void computeWallClearances();
+	/// Advances the agents in two rate classes: the calm agents take the whole step, and the agents in dense regions take sub-steps around them
+	void solveMultiRate();
+	/// Moves the agents among the first count ones of the store that are (or are not) in the fine rate class to the front, and returns their number
+	int partitionAgents(int count, bool fine);
 	///  Returns the objective value for a given set of velocities. Will be used by linesearch
-	double value(const  VectorXd &x);
+	double value(const Eigen::Ref<const VectorXd>& x);
 	/// Returns the objective value and computes the gradient of the objective. Will be used by minimize
-	double value(const  VectorXd &x, VectorXd &grad);
-	/// The inverse time-to-collision energy. TODO: Use a different approximation than the linear extrapolation mentioned in the paper 
-	inline double inverse_ttc_energy(double Pa_x, double Pa_y, double Pb_x, double Pb_y, double Va_x, double Va_y, double Vb_x, double Vb_y, double radius, double* grad = NULL);
-	/// The minimum distance energy across a timestep. TODO: Replace this with velocity uncertainty (see ) that will make this obsolete
-	inline bool min_distance_energy(double Pa_x, double Pa_y, double Pb_x, double Pb_y, double Va_x, double Va_y, double Vb_x, double Vb_y, double radius, double& energy, double* grad = NULL);
-	/// L-BFGS implementation
-	inline void minimize(Vector<double> & x0);
-	/// Inexact line search using the Armijo condition
-	inline double linesearch(const Vector<double> & x0, const Vector<double> & searchDir, const double phi0, const Vector<double>& grad, const double alpha_init = 1.0);
+	double value(const Eigen::Ref<const VectorXd>& x, Eigen::Ref<VectorXd> grad);
+	/// Returns the sum, or the maximum, of a value of the problem over all processes of a distributed run, or just the value otherwise
+	inline double globalSum(double value) const;
+	inline double globalMax(double value) const;
+	/// Returns the maximum absolute entry of a vector of the problem, over all processes of a distributed run
+	inline double maxNorm(const Eigen::Ref<const VectorXd>& v) const;
+#ifdef IMPLICIT_MPI
+	/// Copies the agents near the slabs of other processes to them, and puts the copies of their agents behind the agents of this process in the store and the proximity database
+	void exchangeGhosts();
+	/// Removes the copies of the agents of other processes
+	void removeGhosts();
+	/// Sends the trial velocities of the agents copied to other processes, and receives those of their copies. Called before every evaluation of the energy
+	void exchangeGhostVelocities(const Eigen::Ref<const VectorXd>& vNew);
+	/// Hands the agents that have left the slab over to the processes owning them, after balancing the slabs if requested
+	void migrateAgents(bool balance);
+#endif
+	/// Points the energy terms to the parameters and the obstacle queries of this step
+	void configureEnergy();
+	/// Sorts the agents along the spatial order every few steps, and in NUMA mode moves their state to the memory of the threads that evaluate them
+	void arrangeAgents();
+	/// Splits the agents of the problem into the chunks of the energy evaluations: fixed blocks in deterministic mode, otherwise a few chunks
+	/// per thread holding about the same number of neighbor pairs
+	void balanceChunks();
+	/// Returns the objective value for the given velocities, and computes its gradient into grad with Gradient. Both value functions are instantiations of it
+	template <bool Gradient>
+	double evaluate(const Eigen::Ref<const VectorXd>& x, double* grad);
+	/// Sizes the solver workspace for the current problem, and starts the solve from zero velocities to guarantee collision-freeness
+	void resetVelocities();
+	/// Adds the energy of agent i and of its interactions with its neighbors to f, and with Gradient the gradient of agent i to grad. Returns false if the velocities are infeasible.
+	/// Without Gradient, only the neighbors with a higher active id are visited, as the others count the pair
+	template <bool Gradient>
+	inline bool agentEnergy(int i, const EnergyState& state, double& f, double* grad);
+	/// Minimizes the energy over the velocities with the chosen optimizer, starting from and updating x0
+	inline void minimize(Eigen::Ref<VectorXd> x0);
+	/// L-BFGS implementation, with Nesterov extrapolation or Anderson mixing of the iterates if chosen
+	inline void minimizeLBFGS(Eigen::Ref<VectorXd>& x0);
+	/// Nonlinear conjugate gradient implementation
+	inline void minimizeConjugateGradient(Eigen::Ref<VectorXd>& x0);
+	/// Accelerated gradient descent implementation
+	inline void minimizeAcceleratedGradient(Eigen::Ref<VectorXd>& x0);
+	/// Returns true once the deadline of the step has passed, in which case the solver stops
+	inline bool outOfTime();
+	/// Returns true if the last step of the solver is shorter than the stopping criterion or the solve is out of time, and records the step as the convergence gap
+	inline bool converged(const Eigen::Ref<const VectorXd>& step);
+	/// Puts the Anderson mix of the last count L-BFGS iterates into the trial point of the workspace. Returns false if their steps are linearly dependent
+	bool andersonMix(int count);
+	/// Inexact line search using the Armijo condition, along the opposite of the given direction
+	inline double linesearch(const Eigen::Ref<const VectorXd>& x0, const Eigen::Ref<const VectorXd>& direction, const double phi0, const Eigen::Ref<const VectorXd>& grad, const double alpha_init = 1.0);
 	//@}
+	/// Removes an arrived agent from the compacted list of active agents
+	void removeActiveAgent(int activeID);
+	/// Spawns the agents that the sources owe for the current time step
+	void spawnAgents();
+	/// Returns true if an agent with the given radius can be placed at the given position without overlapping another agent
+	bool isFree(const Vector2D& position, double radius);
+	/// Returns true if the position lies inside a sink
+	bool insideSink(const Vector2D& position) const;
+	/// Returns true if some source will spawn agents in the future
+	bool sourcesPending() const;
+	/// Returns the navigation field towards the goal region, computing it on first use. Returns NULL if navigation fields are disabled or there are no obstacles
+	shared_ptr<const NavigationField> navigationField(const SpawnRegion& goal);
+	/// Returns a random point inside the region
+	Vector2D randomPoint(const SpawnRegion& region);
 
 protected:
 	/// The time step in the simulation.
@@ -124,10 +308,97 @@ protected:
 	SpatialProximityDatabase * _spatialDatabase;
 	/// The agents in the simulation
 	vector<ImplicitAgent* >  _agents;
+	/// The state of the active agents, kept compacted. The slot of an agent in the store is its active id
+	AgentStore _store;
+	/// Agents that have left the simulation and can be reused, together with their proximity tokens
+	vector<ImplicitAgent* >  _agentPool;
+	/// Determine whether agents that leave the simulation are recycled
+	bool _recycleAgents;
+	/// The largest radius of all agents added so far
+	double _maxRadius;
+	/// The spawn sources, and the fractional number of agents that each source still has to spawn
+	vector<SpawnSource> _sources;
+	vector<double> _pendingSpawns;
+	/// The sinks
+	vector<SpawnRegion> _sinks;
+	/// The static obstacles
+	ObstacleGrid _obstacles;
+	/// The distance field of the obstacles, its sampling (zero if not used) and its cache directory
+	shared_ptr<const DistanceField> _distanceField;
+	double _distanceFieldCellSize;
+	string _distanceFieldCache;
+	/// The navigation fields per goal region, owned by the agents following them, their sampling (zero if not used), the clearance from the obstacles
+	/// and their cache directory
+	map<array<double, 4>, weak_ptr<const NavigationField>> _navigationFields;
+	double _navigationCellSize;
+	double _navigationClearance;
+	string _navigationCache;
+	/// The statistics of the current step, and of all previous steps
+	StepStats _stats;
+	vector<StepStats> _statsHistory;
+	/// Scratch list for the free-space queries of the sources
+	vector<ProximityDatabaseItem*> _spawnNeighbors;
+	vector<int> _spawnObstacles;
 	/// Max cpu threads
 	int _max_threads;
+	/// The index of the first core of the pinned threads
+	int _firstCore;
+	/// The threads of this engine, kept for the whole simulation
+	TaskPool _pool;
+	/// The seed of the random generator
+	unsigned int _seed;
+	/// Determine whether the energy is summed in a fixed order, independent of the number of threads
+	bool _deterministic;
+	/// Determine whether the agents are placed for the NUMA nodes of the threads, and whether huge pages are requested
+	bool _numaAware, _hugePages;
+	/// The store capacity when the agents were last placed for the NUMA nodes
+	int _placedCapacity;
+	/// The curve along which the agents are sorted, and the steps between the sorts
+	SpatialOrder _spatialOrder;
+	int _reorderInterval;
+	/// Determine whether isolated agents are left out of the implicit solver
+	bool _levelOfDetail;
+	/// Determine whether the time step adapts to the difficulty of the problem, and its bounds
+	bool _adaptiveTimeStep;
+	double _minTimeStep, _maxTimeStep;
+	/// The solver work per simulated second of the last step, and the factor by which the time step last changed
+	double _lastWorkRate, _timeStepFactor;
+	/// The number of sub-steps of the agents in dense regions per time step, and the number of neighbors from which a region is dense
+	int _multiRate, _denseNeighbors;
+	/// Marks the agents, by id, that take sub-steps in the current step
+	vector<char> _fineAgent;
+	/// The interval at which the paths are sampled, fixed at the first step
+	double _frameDt;
+	/// The number of L-BFGS iterations and of infeasible energy evaluations in the current step
+	int _solverIterations, _solverInfeasible;
+	/// The wall time at which the solver of the current step has to stop (0 if there is no budget), whether the current solve has stopped for it,
+	/// and whether a solve of the step has
+	double _deadline;
+	bool _timedOut, _hitDeadline;
+	/// The largest velocity change of the last full iteration of the current solve, and its maximum over the solves of the step
+	double _stepNorm, _convergenceGap;
+	/// The lowest energy evaluated by the current solve, whose velocities are kept in the workspace when there is a deadline
+	double _bestEnergy;
+	/// The number of agents per block of the deterministic summation, and the number of balanced chunks per thread otherwise
+	static const int _blockSize = 64;
+	static const int _chunksPerThread = 4;
+	/// The first agent of each chunk of the energy evaluations followed by the end of the last chunk, the number of agents they were
+	/// balanced for (-1 once the neighbors change), and the partial energy of each chunk, which are added in a fixed order
+	vector<int> _chunkStart;
+	int _chunkAgents;
+	vector<double> _chunkEnergy;
+	/// The random generator, used e.g. by the sources
+	std::mt19937 _rng;
 	/// The total number of agents
 	unsigned int _noAgents;
+	/// The number of agents that have left the simulation
+	int _noArrived;
+	/// The thread writing the last checkpoint, and whether writing it succeeded
+	std::thread _checkpointWriter;
+	bool _checkpointWritten;
+	/// Identifies checkpoint files, and the version of their layout
+	static const unsigned int _checkpointMagic = 0x504b4349; // "ICKP"
+	static const unsigned int _checkpointVersion = 13;
 
 	/// @name Parameters that affect a simulation. Can be set via a file.
 	//@{
@@ -143,15 +414,42 @@ protected:
 	int _newtonIter;
 	/// Stopping criteria
 	double _eps_x;
-	/// L-BFGS window size
+	/// L-BFGS window size, also used for the Anderson history
 	int _window; 
+	/// The optimization method of the solver
+	Optimizer _optimizer;
+	/// The wall time budget of a step in milliseconds, or 0 for none
+	double _solveBudget;
 	//@}
 
 	/// @name Auxiliary variables needed for performing an implicit step
 	//@{
-	VectorXd _pos, _posNew, _vel, _vGoal, _radius, _vNew;
+	/// The vectors of the solver, among them the velocities and positions of the active agents at the end of the step; x and y are interleaved as in the store
+	SolverWorkspace _work;
 	size_t _noVars;
-	int _activeAgents; // The number of active agents
+	int _activeAgents; // The number of active agents in the implicit problem; the isolated agents follow them in the store
  	vector<vector<ProximityDatabaseItem*>> _nn; // Vector of nearest neighbors per agent
+	vector<vector<int>> _obstacleNn; // Vector of nearby obstacles per agent
+	vector<double> _wallClearance, _wallPoint; // Clearance from the closest obstacle and closest obstacle point per agent, used with the distance field
+	ImplicitEnergy _energy; // The terms of the energy, configured from the parameters
+	//@}
+
+#ifdef IMPLICIT_MPI
+	/// @name State of a distributed run
+	//@{
+	/// The decomposition of the world into slabs, or NULL if the engine simulates the whole world
+	DomainDecomposition* _domain;
+	/// The number of steps between two balancings of the slabs
+	int _balanceInterval;
+	/// The copies of the agents of other processes near the slab, grouped by the process owning them, and the copies that are not in use
+	vector<vector<ImplicitAgent*> > _ghosts;
+	vector<ImplicitAgent*> _ghostPool;
+	/// The agents of this process copied to each other process, in the order of the copies
+	vector<vector<ImplicitAgent*> > _sentGhosts;
+	/// The velocities sent to and received from each process for the copies
+	vector<vector<double> > _ghostVelocitiesOut, _ghostVelocitiesIn;
+	/// The slot of the store of the first copy; the copies are not part of the problem of this process
+	int _ghostBegin;
 	//@}
+#endif
 };
\ No newline at end of file
@@ -29,8 +29,9 @@
 #pragma once
 
 #include <vector>
-#include "lq2D.h"
+#include "lq2d.h"
 #include "ProximityDatabaseItem.h" 
+#include "EigenConfig.h"
 #include <Eigen/Dense>
 using namespace Eigen;
 using std::vector; 
@@ -89,6 +90,13 @@ public:
             lqUpdateForNewLocation (lq, &proxy, p.x(), p.y());
         }
 
+        // take the client object out of the database, keeping the token for later reuse;
+        // the next updateForNewPosition puts it back
+        void removeFromDatabase (void)
+        {
+            lqRemoveFromBin (&proxy);
+        }
+
         // find all neighbors within the given sphere (as center and radius)
         void findNeighbors (const Vector2D& center,
 							const double radius,
@@ -115,6 +123,30 @@ public:
         return new tokenType (item, *this);
     }
 
+    // find all objects within the given sphere (as center and radius), without needing a token
+    void findNeighbors (const Vector2D& center,
+						const double radius,
+                        vector<ProximityDatabaseItem*>& results)
+    {
+            lqMapOverAllObjectsInLocality (lq, center.x(), center.y(), radius, 
+				[](void* clientObject, double distanceSquared, void* clientQueryState) 
+				{
+					vector<ProximityDatabaseItem*>& results = *((vector<ProximityDatabaseItem*>*) clientQueryState);
+					results.push_back((ProximityDatabaseItem*)clientObject); 
+			    }, (void*)&results);
+    }
+
+    // get all objects in the database, bin by bin. Re-inserting them in the reverse order rebuilds the same bin lists
+    void getAllObjects (vector<ProximityDatabaseItem*>& results)
+    {
+            lqMapOverAllObjects (lq, 
+				[](void* clientObject, double distanceSquared, void* clientQueryState) 
+				{
+					vector<ProximityDatabaseItem*>& results = *((vector<ProximityDatabaseItem*>*) clientQueryState);
+					results.push_back((ProximityDatabaseItem*)clientObject); 
+			    }, (void*)&results);
+    }
+
  	
 	Vector2D getOrigin (void) {return _origin;}
 	Vector2D getDivisions (void) {return _divisions;}
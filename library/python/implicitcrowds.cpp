@@ -0,0 +1,658 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+/*!
+*  @file       implicitcrowds.cpp
+*  @brief      Python bindings of the ImplicitEngine.
+*
+*  The state of the active agents is exposed through the buffer protocol as read-only memoryviews that alias the
+*  AgentStore, so numpy.asarray(engine.positions) is an (n, 2) array without any copy. The views only depend on the
+*  Python C API, so the module builds without NumPy.
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "implicitEngine.h"
+#include "Scenario.h"
+#include <climits>
+
+/// The wrapped engine
+struct EngineObject
+{
+	PyObject_HEAD
+	ImplicitEngine* engine;
+	/// True once the engine knows the extent of the environment
+	bool initialized;
+	/// True while a step runs without the GIL
+	bool stepping;
+	/// The number of buffers exported from the agent store. While there are any, the store is not allowed to move
+	int exports;
+};
+
+/// The quantities of the agent store that can be viewed
+enum StoreField { POSITIONS, VELOCITIES, PREFERRED_VELOCITIES, GOALS, RADII, PREFERRED_SPEEDS, IDS };
+
+/// The exporter of one quantity of the agent store; every view of the store is a memoryview of a fresh StoreArrayObject
+struct StoreArrayObject
+{
+	PyObject_HEAD
+	EngineObject* owner;
+	int field;
+	Py_ssize_t shape[2];
+	Py_ssize_t strides[2];
+};
+
+static PyTypeObject EngineType = { PyVarObject_HEAD_INIT(NULL, 0) };
+static PyTypeObject StoreArrayType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+/// Raises an exception and returns false if the engine cannot be used right now
+static bool checkIdle(EngineObject* self)
+{
+	if (!self->initialized)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "the engine has not been initialized");
+		return false;
+	}
+	if (self->stepping)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "the engine is stepping in another thread");
+		return false;
+	}
+	return true;
+}
+
+/// Raises an exception and returns false if adding the given number of agents would move the viewed agent store
+static bool checkGrowth(EngineObject* self, Py_ssize_t count)
+{
+	const AgentStore& store = self->engine->getAgentStore();
+	if (self->exports > 0 && store.size() + count > store.capacity())
+	{
+		PyErr_SetString(PyExc_BufferError, "the agent store has to grow while views of it exist; release them or call reserve() first");
+		return false;
+	}
+	return true;
+}
+
+/// @name Conversion of the arguments
+//@{
+/// Reads the element at the given address of a buffer with the given struct format
+static bool readElement(const char* format, const char* p, double& value)
+{
+	// only native byte order is supported
+	if (*format == '@' || *format == '=' || *format == '<')
+		++format;
+	if (format[0] == 0 || format[1] != 0)
+		return false;
+	switch (*format)
+	{
+	case 'd': value = *(const double*)p; return true;
+	case 'f': value = *(const float*)p; return true;
+	case 'b': value = *(const signed char*)p; return true;
+	case 'B': value = *(const unsigned char*)p; return true;
+	case '?': value = *(const bool*)p; return true;
+	case 'h': value = *(const short*)p; return true;
+	case 'H': value = *(const unsigned short*)p; return true;
+	case 'i': value = *(const int*)p; return true;
+	case 'I': value = *(const unsigned int*)p; return true;
+	case 'l': value = (double)*(const long*)p; return true;
+	case 'L': value = (double)*(const unsigned long*)p; return true;
+	case 'q': value = (double)*(const long long*)p; return true;
+	case 'Q': value = (double)*(const unsigned long long*)p; return true;
+	default: return false;
+	}
+}
+
+/// Reads a number, an array with the given number of rows and columns (1 for a vector), or a sequence of such rows.
+/// A negative number of rows is taken from the argument. Returns false with an exception set if the argument does not fit
+static bool readArray(PyObject* object, const char* name, Py_ssize_t& rows, int columns, vector<double>& values)
+{
+	if (PyNumber_Check(object) && !PyObject_CheckBuffer(object) && !PySequence_Check(object))
+	{
+		double value = PyFloat_AsDouble(object);
+		if (value == -1 && PyErr_Occurred())
+			return false;
+		if (rows < 0)
+		{
+			PyErr_Format(PyExc_ValueError, "%s has to be an array", name);
+			return false;
+		}
+		values.assign(rows*columns, value);
+		return true;
+	}
+
+	if (PyObject_CheckBuffer(object))
+	{
+		Py_buffer view;
+		if (PyObject_GetBuffer(object, &view, PyBUF_RECORDS_RO) < 0)
+			return false;
+		bool valid = view.ndim == (columns == 1 ? 1 : 2) && (columns == 1 || view.shape[1] == columns) && (rows < 0 || view.shape[0] == rows);
+		if (valid)
+		{
+			rows = view.shape[0];
+			values.resize(rows*columns);
+			for (Py_ssize_t i = 0; i < rows && valid; ++i)
+			{
+				for (int j = 0; j < columns && valid; ++j)
+				{
+					const char* p = (const char*)view.buf + i*view.strides[0] + (columns == 1 ? 0 : j*view.strides[1]);
+					valid = readElement(view.format, p, values[i*columns + j]);
+				}
+			}
+		}
+		PyBuffer_Release(&view);
+		if (!valid)
+			PyErr_Format(PyExc_ValueError, "%s has to be a numeric array of shape (%zd%s)", name, rows, columns == 1 ? ",)" : ", 2)");
+		return valid;
+	}
+
+	// a sequence of numbers or of pairs
+	PyObject* sequence = PySequence_Fast(object, "");
+	if (sequence == NULL)
+	{
+		PyErr_Format(PyExc_TypeError, "%s has to be a number, an array or a sequence", name);
+		return false;
+	}
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(sequence);
+	bool valid = rows < 0 || count == rows;
+	if (valid)
+	{
+		rows = count;
+		values.resize(rows*columns);
+	}
+	for (Py_ssize_t i = 0; i < count && valid; ++i)
+	{
+		PyObject* item = PySequence_Fast_GET_ITEM(sequence, i);
+		if (columns == 1)
+			values[i] = PyFloat_AsDouble(item);
+		else
+		{
+			PyObject* pair = PySequence_Fast(item, "");
+			valid = pair != NULL && PySequence_Fast_GET_SIZE(pair) == columns;
+			for (int j = 0; j < columns && valid; ++j)
+				values[i*columns + j] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(pair, j));
+			Py_XDECREF(pair);
+		}
+		valid = valid && !PyErr_Occurred();
+	}
+	Py_DECREF(sequence);
+	if (!valid)
+	{
+		PyErr_Clear();
+		PyErr_Format(PyExc_ValueError, "%s has to hold %zd %s", name, rows, columns == 1 ? "numbers" : "pairs of numbers");
+	}
+	return valid;
+}
+//@}
+
+/// @name StoreArray
+//@{
+static void StoreArray_dealloc(StoreArrayObject* self)
+{
+	Py_DECREF(self->owner);
+	PyObject_Del(self);
+}
+
+static int StoreArray_getbuffer(StoreArrayObject* self, Py_buffer* view, int flags)
+{
+	view->obj = NULL;
+	if (self->owner->stepping)
+	{
+		PyErr_SetString(PyExc_BufferError, "the engine is stepping in another thread");
+		return -1;
+	}
+	if (flags & PyBUF_WRITABLE)
+	{
+		PyErr_SetString(PyExc_BufferError, "the agent state is read-only");
+		return -1;
+	}
+
+	static double empty[2];
+	const AgentStore& store = self->owner->engine->getAgentStore();
+	int n = store.size();
+	void* data = NULL;
+	const char* format = "d";
+	Py_ssize_t itemSize = sizeof(double);
+	int columns = 1;
+	switch (self->field)
+	{
+	case POSITIONS: data = (void*)store.positions().data(); columns = 2; break;
+	case VELOCITIES: data = (void*)store.velocities().data(); columns = 2; break;
+	case PREFERRED_VELOCITIES: data = (void*)store.vPrefs().data(); columns = 2; break;
+	case GOALS: data = (void*)store.goals().data(); columns = 2; break;
+	case RADII: data = (void*)store.radii().data(); break;
+	case PREFERRED_SPEEDS: data = (void*)store.prefSpeeds().data(); break;
+	case IDS: data = (void*)store.ids().data(); format = "i"; itemSize = sizeof(int); break;
+	}
+	if (n == 0 || data == NULL)
+		data = empty;
+
+	self->shape[0] = n;
+	self->shape[1] = columns;
+	self->strides[0] = columns*itemSize;
+	self->strides[1] = itemSize;
+
+	view->buf = data;
+	view->obj = (PyObject*)self;
+	Py_INCREF(self);
+	view->len = n*columns*itemSize;
+	view->readonly = 1;
+	view->itemsize = itemSize;
+	view->format = (flags & PyBUF_FORMAT) ? (char*)format : NULL;
+	view->ndim = columns == 1 ? 1 : 2;
+	view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	++self->owner->exports;
+	return 0;
+}
+
+static void StoreArray_releasebuffer(StoreArrayObject* self, Py_buffer* view)
+{
+	--self->owner->exports;
+}
+
+static PyBufferProcs StoreArray_as_buffer = { (getbufferproc)StoreArray_getbuffer, (releasebufferproc)StoreArray_releasebuffer };
+//@}
+
+/// @name Engine
+//@{
+static PyObject* Engine_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+	EngineObject* self = (EngineObject*)type->tp_alloc(type, 0);
+	if (self == NULL)
+		return NULL;
+	self->engine = new ImplicitEngine();
+	self->engine->setTimeStep(0.1);
+	self->engine->setMaxSteps(INT_MAX);
+	self->initialized = false;
+	self->stepping = false;
+	self->exports = 0;
+	return (PyObject*)self;
+}
+
+static int Engine_init(EngineObject* self, PyObject* args, PyObject* kwds)
+{
+	static const char* keywords[] = { "width", "height", "x_cells", "y_cells", NULL };
+	double width, height;
+	int xCells = 10, yCells = 10;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "dd|ii", (char**)keywords, &width, &height, &xCells, &yCells))
+		return -1;
+	if (self->initialized)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "the engine has already been initialized");
+		return -1;
+	}
+	self->engine->init(width, height, xCells, yCells);
+	self->initialized = true;
+	return 0;
+}
+
+static void Engine_dealloc(EngineObject* self)
+{
+	delete self->engine;
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyObject* Engine_from_scenario(PyTypeObject* type, PyObject* args)
+{
+	const char* fileName;
+	if (!PyArg_ParseTuple(args, "s", &fileName))
+		return NULL;
+	Scenario scenario;
+	if (!scenario.load(fileName))
+		return PyErr_Format(PyExc_OSError, "cannot read the scenario %s", fileName);
+	EngineObject* self = (EngineObject*)Engine_new(type, NULL, NULL);
+	if (self == NULL)
+		return NULL;
+	scenario.populate(*self->engine);
+	self->initialized = true;
+	return (PyObject*)self;
+}
+
+static PyObject* Engine_load_parameters(EngineObject* self, PyObject* args)
+{
+	const char* fileName;
+	if (!PyArg_ParseTuple(args, "s", &fileName) || !checkIdle(self))
+		return NULL;
+	Parser parser;
+	if (!parser.registerParameters(fileName))
+		return PyErr_Format(PyExc_OSError, "cannot read the parameters %s", fileName);
+	self->engine->readParameters(parser);
+	Py_RETURN_NONE;
+}
+
+static PyObject* Engine_set_parameters(EngineObject* self, PyObject* args, PyObject* kwds)
+{
+	if (PyTuple_GET_SIZE(args) > 0)
+	{
+		PyErr_SetString(PyExc_TypeError, "set_parameters() only takes keyword arguments");
+		return NULL;
+	}
+	if (!checkIdle(self))
+		return NULL;
+	// the values go through the parser, so they are interpreted exactly as in a parameters file
+	Parser parser;
+	PyObject *key, *value;
+	Py_ssize_t position = 0;
+	while (kwds != NULL && PyDict_Next(kwds, &position, &key, &value))
+	{
+		if (PyFloat_Check(value))
+		{
+			parser.setValue(PyUnicode_AsUTF8(key), PyFloat_AsDouble(value));
+			continue;
+		}
+		PyObject* text = PyBool_Check(value) ? PyUnicode_FromString(value == Py_True ? "1" : "0") : PyObject_Str(value);
+		if (text == NULL)
+			return NULL;
+		parser.setValue(PyUnicode_AsUTF8(key), PyUnicode_AsUTF8(text));
+		Py_DECREF(text);
+	}
+	self->engine->readParameters(parser);
+	Py_RETURN_NONE;
+}
+
+static PyObject* Engine_add_agents(EngineObject* self, PyObject* args, PyObject* kwds)
+{
+	static const char* keywords[] = { "positions", "goals", "pref_speeds", "radii", "velocities", "goal_radii", "gids", NULL };
+	PyObject *positionsArg, *goalsArg, *prefSpeedsArg = NULL, *radiiArg = NULL, *velocitiesArg = NULL, *goalRadiiArg = NULL, *gidsArg = NULL;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|OOOOO", (char**)keywords,
+		&positionsArg, &goalsArg, &prefSpeedsArg, &radiiArg, &velocitiesArg, &goalRadiiArg, &gidsArg))
+		return NULL;
+	if (!checkIdle(self))
+		return NULL;
+
+	// the defaults are those of the scenario files
+	Py_ssize_t n = -1;
+	vector<double> positions, goals, prefSpeeds, radii, velocities, goalRadii, gids;
+	if (!readArray(positionsArg, "positions", n, 2, positions) || !readArray(goalsArg, "goals", n, 2, goals))
+		return NULL;
+	if (prefSpeedsArg == NULL) prefSpeeds.assign(n, 1.3); else if (!readArray(prefSpeedsArg, "pref_speeds", n, 1, prefSpeeds)) return NULL;
+	if (radiiArg == NULL) radii.assign(n, 0.24); else if (!readArray(radiiArg, "radii", n, 1, radii)) return NULL;
+	if (velocitiesArg == NULL) velocities.assign(2 * n, 0.); else if (!readArray(velocitiesArg, "velocities", n, 2, velocities)) return NULL;
+	if (goalRadiiArg == NULL) goalRadii.assign(n, 1.); else if (!readArray(goalRadiiArg, "goal_radii", n, 1, goalRadii)) return NULL;
+	if (gidsArg == NULL) gids.assign(n, 0.); else if (!readArray(gidsArg, "gids", n, 1, gids)) return NULL;
+	if (!checkGrowth(self, n))
+		return NULL;
+
+	PyObject* ids = PyList_New(n);
+	if (ids == NULL)
+		return NULL;
+	AgentInitialParameters par;
+	par.maxSpeed = 2.;
+	self->engine->reserveAgents(self->engine->getNumActiveAgents() + (int)n);
+	for (Py_ssize_t i = 0; i < n; ++i)
+	{
+		par.position = Vector2D(positions[2 * i], positions[2 * i + 1]);
+		par.goal = Vector2D(goals[2 * i], goals[2 * i + 1]);
+		par.velocity = Vector2D(velocities[2 * i], velocities[2 * i + 1]);
+		par.prefSpeed = prefSpeeds[i];
+		par.radius = radii[i];
+		par.goalRadius = goalRadii[i];
+		par.gid = (int)gids[i];
+		self->engine->addAgent(par);
+		PyList_SET_ITEM(ids, i, PyLong_FromLong(par.id));
+	}
+	return ids;
+}
+
+static PyObject* Engine_add_obstacle(EngineObject* self, PyObject* args)
+{
+	PyObject* verticesArg;
+	if (!PyArg_ParseTuple(args, "O", &verticesArg) || !checkIdle(self))
+		return NULL;
+	Py_ssize_t n = -1;
+	vector<double> values;
+	if (!readArray(verticesArg, "vertices", n, 2, values))
+		return NULL;
+	if (n < 2)
+	{
+		PyErr_SetString(PyExc_ValueError, "an obstacle needs at least two vertices");
+		return NULL;
+	}
+	vector<Vector2D> vertices(n);
+	for (Py_ssize_t i = 0; i < n; ++i)
+		vertices[i] = Vector2D(values[2 * i], values[2 * i + 1]);
+	self->engine->addObstacle(vertices);
+	Py_RETURN_NONE;
+}
+
+static PyObject* Engine_reserve(EngineObject* self, PyObject* args)
+{
+	int count;
+	if (!PyArg_ParseTuple(args, "i", &count) || !checkIdle(self))
+		return NULL;
+	if (!checkGrowth(self, count - self->engine->getNumActiveAgents()))
+		return NULL;
+	self->engine->reserveAgents(count);
+	Py_RETURN_NONE;
+}
+
+static PyObject* Engine_step(EngineObject* self, PyObject* args, PyObject* kwds)
+{
+	static const char* keywords[] = { "steps", NULL };
+	int steps = 1;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i", (char**)keywords, &steps) || !checkIdle(self))
+		return NULL;
+
+	// while the store is viewed, a step that could spawn more agents than fit in the store is not taken
+	ImplicitEngine* engine = self->engine;
+	bool pinned = self->exports > 0, fits = true;
+	// the NUMA mode moves the agent state to the memory of the threads
+	if (pinned && engine->getNumaAware())
+	{
+		PyErr_SetString(PyExc_BufferError, "the NUMA mode moves the agent store while views of it exist; release them first");
+		return NULL;
+	}
+	int taken = 0;
+	self->stepping = true;
+	Py_BEGIN_ALLOW_THREADS
+	for (; taken < steps && !engine->endSimulation(); ++taken)
+	{
+		const AgentStore& store = engine->getAgentStore();
+		if (pinned && store.size() + engine->getMaxSpawns() > store.capacity())
+		{
+			fits = false;
+			break;
+		}
+		engine->updateSimulation();
+	}
+	Py_END_ALLOW_THREADS
+	self->stepping = false;
+
+	if (!fits)
+		return PyErr_Format(PyExc_BufferError, "stopped after %d steps: the sources would grow the agent store while views of it exist; release them or call reserve() first", taken);
+	return PyLong_FromLong(taken);
+}
+
+static PyObject* Engine_path(EngineObject* self, PyObject* args)
+{
+	int id;
+	if (!PyArg_ParseTuple(args, "i", &id) || !checkIdle(self))
+		return NULL;
+	if (id < 0 || id >= (int)self->engine->getAgents().size() || self->engine->getAgent(id) == NULL)
+		return PyErr_Format(PyExc_IndexError, "there is no agent with id %d", id);
+
+	// the path is copied, as the agent keeps extending it
+	vector<Vector2D> path = self->engine->getAgent(id)->path();
+	PyObject* bytes = PyBytes_FromStringAndSize(NULL, path.size() * 2 * sizeof(double));
+	if (bytes == NULL)
+		return NULL;
+	double* data = (double*)PyBytes_AS_STRING(bytes);
+	for (size_t i = 0; i < path.size(); ++i)
+	{
+		data[2 * i] = path[i].x();
+		data[2 * i + 1] = path[i].y();
+	}
+	PyObject* view = PyMemoryView_FromObject(bytes);
+	Py_DECREF(bytes);
+	if (view == NULL)
+		return NULL;
+	PyObject* shape = Py_BuildValue("(ni)", (Py_ssize_t)path.size(), 2);
+	PyObject* cast = PyObject_CallMethod(view, "cast", "sO", "d", shape);
+	Py_DECREF(view);
+	Py_XDECREF(shape);
+	return cast;
+}
+
+static PyObject* Engine_view(EngineObject* self, void* field)
+{
+	if (!checkIdle(self))
+		return NULL;
+	StoreArrayObject* array = PyObject_New(StoreArrayObject, &StoreArrayType);
+	if (array == NULL)
+		return NULL;
+	Py_INCREF(self);
+	array->owner = self;
+	array->field = (int)(Py_ssize_t)field;
+	PyObject* view = PyMemoryView_FromObject((PyObject*)array);
+	Py_DECREF(array);
+	return view;
+}
+
+/// Getters and setters of the scalar properties
+#define ENGINE_GETTER(name, expression) \
+	static PyObject* Engine_get_##name(EngineObject* self, void*) { if (!checkIdle(self)) return NULL; ImplicitEngine* engine = self->engine; return expression; }
+#define ENGINE_SETTER(name, format, type, statement) \
+	static int Engine_set_##name(EngineObject* self, PyObject* value, void*) \
+	{ \
+		type v; \
+		if (value == NULL) { PyErr_SetString(PyExc_AttributeError, "cannot delete the attribute"); return -1; } \
+		if (!checkIdle(self) || !PyArg_Parse(value, format, &v)) return -1; \
+		ImplicitEngine* engine = self->engine; statement; return 0; \
+	}
+
+ENGINE_GETTER(time, PyFloat_FromDouble(engine->getGlobalTime()))
+ENGINE_GETTER(iteration, PyLong_FromLong(engine->getIterationNumber()))
+ENGINE_GETTER(num_agents, PyLong_FromLong(engine->getNumAgents()))
+ENGINE_GETTER(num_active_agents, PyLong_FromLong(engine->getNumActiveAgents()))
+ENGINE_GETTER(num_arrived_agents, PyLong_FromLong(engine->getNumArrivedAgents()))
+ENGINE_GETTER(capacity, PyLong_FromLong(engine->getAgentStore().capacity()))
+ENGINE_GETTER(finished, PyBool_FromLong(engine->endSimulation()))
+ENGINE_GETTER(time_step, PyFloat_FromDouble(engine->getTimeStep()))
+ENGINE_SETTER(time_step, "d", double, engine->setTimeStep(v))
+ENGINE_GETTER(frame_step, PyFloat_FromDouble(engine->getFrameStep()))
+ENGINE_SETTER(frame_step, "d", double, engine->setFrameStep(v))
+ENGINE_GETTER(max_steps, PyLong_FromLong(engine->getMaxSteps()))
+ENGINE_SETTER(max_steps, "i", int, engine->setMaxSteps(v))
+ENGINE_GETTER(num_threads, PyLong_FromLong(engine->getNumThreads()))
+ENGINE_SETTER(num_threads, "i", int, engine->setNumThreads(v))
+ENGINE_GETTER(seed, PyLong_FromUnsignedLong(engine->getSeed()))
+ENGINE_SETTER(seed, "I", unsigned int, engine->setSeed(v))
+ENGINE_GETTER(solve_budget, PyFloat_FromDouble(engine->getSolveBudget()))
+ENGINE_SETTER(solve_budget, "d", double, engine->setSolveBudget(v))
+ENGINE_GETTER(convergence_gap, PyFloat_FromDouble(engine->getConvergenceGap()))
+ENGINE_GETTER(hit_deadline, PyBool_FromLong(engine->hitDeadline()))
+
+static PyMethodDef Engine_methods[] = {
+	{ "from_scenario", (PyCFunction)Engine_from_scenario, METH_VARARGS | METH_CLASS,
+	  "from_scenario(path)\n\nCreates an engine with the environment, agents, sources, sinks and obstacles of a scenario file." },
+	{ "load_parameters", (PyCFunction)Engine_load_parameters, METH_VARARGS,
+	  "load_parameters(path)\n\nReads the parameters of a parameters file such as implicit.ini." },
+	{ "set_parameters", (PyCFunction)Engine_set_parameters, METH_VARARGS | METH_KEYWORDS,
+	  "set_parameters(**values)\n\nSets parameters by the names of the parameters file, e.g. set_parameters(neighborDist=7, levelOfDetail=True)." },
+	{ "add_agents", (PyCFunction)Engine_add_agents, METH_VARARGS | METH_KEYWORDS,
+	  "add_agents(positions, goals, pref_speeds=1.3, radii=0.24, velocities=0, goal_radii=1, gids=0)\n\n"
+	  "Adds n agents at once. positions, goals and velocities are (n, 2) arrays, the rest numbers or arrays of length n. Returns the ids of the agents." },
+	{ "add_obstacle", (PyCFunction)Engine_add_obstacle, METH_VARARGS,
+	  "add_obstacle(vertices)\n\nAdds a line segment (two vertices) or a closed polygon given as a (k, 2) array." },
+	{ "reserve", (PyCFunction)Engine_reserve, METH_VARARGS,
+	  "reserve(count)\n\nMakes room for count active agents, so that the views of the agent state stay valid while agents are added." },
+	{ "step", (PyCFunction)Engine_step, METH_VARARGS | METH_KEYWORDS,
+	  "step(steps=1)\n\nTakes up to the given number of steps, stopping early when the simulation ends, and returns the number of steps taken. "
+	  "The GIL is released meanwhile." },
+	{ "path", (PyCFunction)Engine_path, METH_VARARGS,
+	  "path(id)\n\nReturns a copy of the path of an agent, sampled every frame_step, as a (k, 2) memoryview." },
+	{ NULL }
+};
+
+#define ENGINE_VIEW(name, field, doc) { (char*)name, (getter)Engine_view, NULL, (char*)doc, (void*)field }
+#define ENGINE_PROPERTY(name, doc) { (char*)#name, (getter)Engine_get_##name, NULL, (char*)doc, NULL }
+#define ENGINE_WRITABLE_PROPERTY(name, doc) { (char*)#name, (getter)Engine_get_##name, (setter)Engine_set_##name, (char*)doc, NULL }
+
+static PyGetSetDef Engine_getset[] = {
+	ENGINE_VIEW("positions", POSITIONS, "(n, 2) read-only view of the positions of the active agents"),
+	ENGINE_VIEW("velocities", VELOCITIES, "(n, 2) read-only view of the velocities of the active agents"),
+	ENGINE_VIEW("preferred_velocities", PREFERRED_VELOCITIES, "(n, 2) read-only view of the preferred velocities of the active agents"),
+	ENGINE_VIEW("goals", GOALS, "(n, 2) read-only view of the goals of the active agents"),
+	ENGINE_VIEW("radii", RADII, "(n,) read-only view of the radii of the active agents"),
+	ENGINE_VIEW("pref_speeds", PREFERRED_SPEEDS, "(n,) read-only view of the preferred speeds of the active agents"),
+	ENGINE_VIEW("ids", IDS, "(n,) read-only view of the ids of the active agents, i.e. the agent in each row of the other views"),
+	ENGINE_PROPERTY(time, "the simulation time"),
+	ENGINE_PROPERTY(iteration, "the number of steps taken"),
+	ENGINE_PROPERTY(num_agents, "the number of agents that have entered the simulation"),
+	ENGINE_PROPERTY(num_active_agents, "the number of agents that have not left the simulation yet"),
+	ENGINE_PROPERTY(num_arrived_agents, "the number of agents that have left the simulation"),
+	ENGINE_PROPERTY(capacity, "the number of active agents that fit in the agent store before it moves"),
+	ENGINE_PROPERTY(finished, "true once all agents have left or max_steps have been taken"),
+	ENGINE_WRITABLE_PROPERTY(time_step, "the time step, 0.1 by default"),
+	ENGINE_WRITABLE_PROPERTY(frame_step, "the interval at which the paths are sampled"),
+	ENGINE_WRITABLE_PROPERTY(max_steps, "the number of steps after which the simulation ends"),
+	ENGINE_WRITABLE_PROPERTY(num_threads, "the number of threads of the engine"),
+	ENGINE_WRITABLE_PROPERTY(seed, "the seed of the random generator of the engine"),
+	ENGINE_WRITABLE_PROPERTY(solve_budget, "the wall time of a step in milliseconds after which the solver keeps the best collision-free velocities found, 0 for none"),
+	ENGINE_PROPERTY(convergence_gap, "the largest velocity change of the last full solver iteration of the last step, below eps_x if it converged"),
+	ENGINE_PROPERTY(hit_deadline, "true if the solve_budget of the last step stopped its solver"),
+	{ NULL }
+};
+//@}
+
+static PyModuleDef implicitcrowdsModule = { PyModuleDef_HEAD_INIT, "implicitcrowds",
+	"Python bindings of the implicit crowd simulator.\n\n"
+	"The views of the agent state (Engine.positions etc.) are memoryviews of the engine memory; numpy.asarray() turns them into arrays without copying. "
+	"Row i of every view holds the active agent ids[i]. The rows are reordered when agents leave, so the views should be taken again after every step. "
+	"While views exist, the agent store cannot grow: adding agents or steps whose sources would spawn more agents than reserve() made room for raise BufferError.",
+	-1, NULL };
+
+PyMODINIT_FUNC PyInit_implicitcrowds(void)
+{
+	StoreArrayType.tp_name = "implicitcrowds.StoreArray";
+	StoreArrayType.tp_basicsize = sizeof(StoreArrayObject);
+	StoreArrayType.tp_dealloc = (destructor)StoreArray_dealloc;
+	StoreArrayType.tp_as_buffer = &StoreArray_as_buffer;
+	StoreArrayType.tp_flags = Py_TPFLAGS_DEFAULT;
+	StoreArrayType.tp_doc = "Exporter of one quantity of the agent store";
+
+	EngineType.tp_name = "implicitcrowds.Engine";
+	EngineType.tp_basicsize = sizeof(EngineObject);
+	EngineType.tp_new = Engine_new;
+	EngineType.tp_init = (initproc)Engine_init;
+	EngineType.tp_dealloc = (destructor)Engine_dealloc;
+	EngineType.tp_methods = Engine_methods;
+	EngineType.tp_getset = Engine_getset;
+	EngineType.tp_flags = Py_TPFLAGS_DEFAULT;
+	EngineType.tp_doc = "Engine(width, height, x_cells=10, y_cells=10)\n\n"
+		"An implicit crowd engine for an environment of the given extent, whose neighbor grid has the given number of cells.";
+
+	if (PyType_Ready(&StoreArrayType) < 0 || PyType_Ready(&EngineType) < 0)
+		return NULL;
+	PyObject* module = PyModule_Create(&implicitcrowdsModule);
+	if (module == NULL)
+		return NULL;
+	Py_INCREF(&EngineType);
+	if (PyModule_AddObject(module, "Engine", (PyObject*)&EngineType) < 0)
+	{
+		Py_DECREF(&EngineType);
+		Py_DECREF(module);
+		return NULL;
+	}
+	return module;
+}
@@ -0,0 +1,30 @@
+# Builds the implicitcrowds Python module from the sources of the library:
+#   python setup.py build_ext --inplace
+# Compile with -DIMPLICIT_STATS or -DIMPLICIT_TRACE through the CFLAGS (CL on Windows) environment variable if needed.
+import glob
+import os
+import sys
+from setuptools import setup, Extension
+
+root = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..'))
+sources = [s for s in glob.glob(os.path.join(root, 'library', 'src', '*.cpp')) if os.path.basename(s) != 'Main.cpp']
+
+if sys.platform == 'win32':
+    compileArgs = ['/openmp', '/EHsc', '/O2']
+    linkArgs = []
+else:
+    compileArgs = ['-std=c++14', '-fopenmp', '-O2']
+    linkArgs = ['-fopenmp']
+
+setup(
+    name='implicitcrowds',
+    version='1.0',
+    description='Python bindings of the implicit crowd simulator',
+    ext_modules=[Extension(
+        'implicitcrowds',
+        sources=['implicitcrowds.cpp'] + sources,
+        include_dirs=[os.path.join(root, 'library', 'include'), os.path.join(root, 'library', 'include', 'proximitydatabase'), os.path.join(root, 'external')],
+        extra_compile_args=compileArgs,
+        extra_link_args=linkArgs,
+        language='c++')],
+)
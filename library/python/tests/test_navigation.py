@@ -0,0 +1,44 @@
+# Runs with the module built in place (see setup.py):
+#   python -m unittest discover -s library/python/tests
+import math
+import os
+import sys
+import unittest
+
+here = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(here, '..'))
+import implicitcrowds
+
+data = os.path.normpath(os.path.join(here, '..', '..', '..', 'data'))
+
+
+class NavigationFieldTest(unittest.TestCase):
+    def engine(self):
+        engine = implicitcrowds.Engine.from_scenario(os.path.join(data, 'doorway_agents.csv'))
+        engine.load_parameters(os.path.join(data, 'implicit.ini'))
+        engine.set_parameters(navigationField=0.5, navigationClearance=0.3)
+        engine.time_step = 0.1
+        return engine
+
+    def test_obstacle_added_mid_run(self):
+        # the new obstacle rebuilds the grid and the fields, which the agents must not follow after they are freed
+        engine = self.engine()
+        self.assertEqual(engine.step(10), 10)
+        engine.add_obstacle([(3, -10), (3, -6)])
+        self.assertEqual(engine.step(10), 10)
+        for x, y in engine.positions.tolist():
+            self.assertTrue(math.isfinite(x) and math.isfinite(y))
+
+    def test_polygon_added_twice(self):
+        engine = self.engine()
+        engine.step(5)
+        engine.add_obstacle([(6, 3), (7, 3), (7, 4), (6, 4)])
+        engine.step(5)
+        engine.add_obstacle([(6, -4), (7, -4), (7, -3), (6, -3)])
+        engine.step(5)
+        for x, y in engine.positions.tolist():
+            self.assertTrue(math.isfinite(x) and math.isfinite(y))
+
+
+if __name__ == '__main__':
+    unittest.main()
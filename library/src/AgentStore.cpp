@@ -0,0 +1,236 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "AgentStore.h"
+#include "ImplicitAgent.h"
+#include "TaskPool.h"
+#include <algorithm>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <stdint.h>
+#endif
+
+
+AgentStore::AgentStore()
+{
+	_size = 0;
+	_capacity = 0;
+}
+
+void AgentStore::reserve(int n)
+{
+	if (n <= _capacity)
+		return;
+
+	// keep the existing entries, the rest is uninitialized
+	_position.conservativeResize(2 * n);
+	_velocity.conservativeResize(2 * n);
+	_vPref.conservativeResize(2 * n);
+	_goal.conservativeResize(2 * n);
+	_radius.conservativeResize(n);
+	_prefSpeed.conservativeResize(n);
+	_goalRadiusSq.conservativeResize(n);
+	_gid.resize(n);
+	_id.resize(n);
+	_agents.resize(n);
+	_capacity = n;
+}
+
+/// Spreads the 16 bits of v to the even bits of the result
+static unsigned long long spreadBits(unsigned int v)
+{
+	unsigned long long x = v;
+	x = (x | x << 8) & 0x00FF00FFULL;
+	x = (x | x << 4) & 0x0F0F0F0FULL;
+	x = (x | x << 2) & 0x33333333ULL;
+	x = (x | x << 1) & 0x55555555ULL;
+	return x;
+}
+
+/// Returns the index of a cell of a 2^16 x 2^16 grid along the Morton (Z-order) curve
+static unsigned long long mortonKey(unsigned int x, unsigned int y)
+{
+	return spreadBits(x) | spreadBits(y) << 1;
+}
+
+/// Returns the index of a cell of a 2^16 x 2^16 grid along the Hilbert curve, which unlike the Morton curve never jumps between distant cells
+static unsigned long long hilbertKey(unsigned int x, unsigned int y)
+{
+	unsigned long long d = 0;
+	for (unsigned int s = 1u << 15; s > 0; s >>= 1)
+	{
+		const unsigned int rx = (x & s) ? 1 : 0, ry = (y & s) ? 1 : 0;
+		d += (unsigned long long)s * s * ((3 * rx) ^ ry);
+		// rotate the quadrant, so that the curve inside it starts and ends next to its neighbors
+		if (ry == 0)
+		{
+			if (rx == 1)
+			{
+				x = 0xFFFF - x;
+				y = 0xFFFF - y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+void AgentStore::reorder(const vector<int>& order)
+{
+	const int count = (int)order.size();
+	VectorXd* arrays[] = { &_position, &_velocity, &_vPref, &_goal, &_radius, &_prefSpeed, &_goalRadiusSq };
+	for (VectorXd* array : arrays)
+	{
+		const int stride = (int)array->size() / _capacity;
+		const VectorXd old = array->head(count*stride);
+		for (int i = 0; i < count; ++i)
+			array->segment(i*stride, stride) = old.segment(order[i] * stride, stride);
+	}
+	vector<int> gid(_gid.begin(), _gid.begin() + count), id(_id.begin(), _id.begin() + count);
+	vector<ImplicitAgent*> agents(_agents.begin(), _agents.begin() + count);
+	for (int i = 0; i < count; ++i)
+	{
+		_gid[i] = gid[order[i]];
+		_id[i] = id[order[i]];
+		_agents[i] = agents[order[i]];
+		_agents[i]->setActiveID(i);
+	}
+}
+
+void AgentStore::sortAlong(SpatialOrder curve, int count)
+{
+	if (curve == InsertionOrder || count < 2)
+		return;
+
+	// the positions are mapped to a square grid of 2^16 cells per side over their bounding box
+	double minX = _position[0], maxX = minX, minY = _position[1], maxY = minY;
+	for (int i = 1; i < count; ++i)
+	{
+		minX = std::min(minX, _position[2 * i]);
+		maxX = std::max(maxX, _position[2 * i]);
+		minY = std::min(minY, _position[2 * i + 1]);
+		maxY = std::max(maxY, _position[2 * i + 1]);
+	}
+	const double scale = 0xFFFF / std::max(std::max(maxX - minX, maxY - minY), 1e-9);
+
+	// ties keep the current order, so the sort is deterministic
+	vector<std::pair<unsigned long long, int> > keys(count);
+	for (int i = 0; i < count; ++i)
+	{
+		const unsigned int x = (unsigned int)((_position[2 * i] - minX)*scale), y = (unsigned int)((_position[2 * i + 1] - minY)*scale);
+		keys[i].first = curve == MortonOrder ? mortonKey(x, y) : hilbertKey(x, y);
+		keys[i].second = i;
+	}
+	std::sort(keys.begin(), keys.end());
+	vector<int> order(count);
+	for (int i = 0; i < count; ++i)
+		order[i] = keys[i].second;
+	reorder(order);
+}
+
+void AgentStore::place(TaskPool& pool, bool hugePages)
+{
+	VectorXd* arrays[] = { &_position, &_velocity, &_vPref, &_goal, &_radius, &_prefSpeed, &_goalRadiusSq };
+	const int n = pool.size();
+	for (VectorXd* array : arrays)
+	{
+		if (array->size() == 0)
+			continue;
+		const int stride = (int)array->size() / _capacity;
+		VectorXd placed(array->size());
+#ifdef __linux__
+		// transparent huge pages are assigned when the pages are first touched, so the advice has to come first. Only whole
+		// huge pages inside the array can be advised; Windows only offers large pages to privileged processes
+		const uintptr_t hugePage = 2 << 20;
+		uintptr_t begin = ((uintptr_t)placed.data() + hugePage - 1) & ~(hugePage - 1);
+		uintptr_t end = ((uintptr_t)(placed.data() + placed.size())) & ~(hugePage - 1);
+		if (hugePages && end > begin)
+			madvise((void*)begin, end - begin, MADV_HUGEPAGE);
+#endif
+		pool.run(n, [&](int t, int)
+		{
+			const int used = stride*(int)((long long)t*_size / n), usedEnd = stride*(int)((long long)(t + 1)*_size / n);
+			const int spare = (_capacity - _size)*stride;
+			const int spareBegin = _size*stride + (int)((long long)t*spare / n), spareEnd = _size*stride + (int)((long long)(t + 1)*spare / n);
+			placed.segment(used, usedEnd - used) = array->segment(used, usedEnd - used);
+			placed.segment(spareBegin, spareEnd - spareBegin).setZero();
+		}, false);
+		array->swap(placed);
+	}
+}
+
+int AgentStore::add(ImplicitAgent* agent, const AgentInitialParameters& parameters)
+{
+	if (_size == _capacity)
+		reserve(std::max(2 * _capacity, 16));
+
+	int slot = _size++;
+	_agents[slot] = agent;
+	setPosition(slot, parameters.position);
+	setVelocity(slot, parameters.velocity);
+	setVPref(slot, Vector2D(0, 0));
+	_goal[2 * slot] = parameters.goal.x();
+	_goal[2 * slot + 1] = parameters.goal.y();
+	_radius[slot] = parameters.radius;
+	_prefSpeed[slot] = parameters.prefSpeed;
+	_goalRadiusSq[slot] = parameters.goalRadius*parameters.goalRadius;
+	_gid[slot] = parameters.gid;
+	_id[slot] = parameters.id;
+	return slot;
+}
+
+void AgentStore::remove(int slot)
+{
+	int last = --_size;
+	if (slot != last)
+	{
+		_agents[slot] = _agents[last];
+		_position.segment<2>(2 * slot) = _position.segment<2>(2 * last);
+		_velocity.segment<2>(2 * slot) = _velocity.segment<2>(2 * last);
+		_vPref.segment<2>(2 * slot) = _vPref.segment<2>(2 * last);
+		_goal.segment<2>(2 * slot) = _goal.segment<2>(2 * last);
+		_radius[slot] = _radius[last];
+		_prefSpeed[slot] = _prefSpeed[last];
+		_goalRadiusSq[slot] = _goalRadiusSq[last];
+		_gid[slot] = _gid[last];
+		_id[slot] = _id[last];
+		_agents[slot]->setActiveID(slot);
+	}
+	_agents[last] = NULL;
+}
+
+void AgentStore::swap(int a, int b)
+{
+	if (a == b)
+		return;
+	std::swap(_agents[a], _agents[b]);
+	_position.segment<2>(2 * a).swap(_position.segment<2>(2 * b));
+	_velocity.segment<2>(2 * a).swap(_velocity.segment<2>(2 * b));
+	_vPref.segment<2>(2 * a).swap(_vPref.segment<2>(2 * b));
+	_goal.segment<2>(2 * a).swap(_goal.segment<2>(2 * b));
+	std::swap(_radius[a], _radius[b]);
+	std::swap(_prefSpeed[a], _prefSpeed[b]);
+	std::swap(_goalRadiusSq[a], _goalRadiusSq[b]);
+	std::swap(_gid[a], _gid[b]);
+	std::swap(_id[a], _id[b]);
+	_agents[a]->setActiveID(a);
+	_agents[b]->setActiveID(b);
+}
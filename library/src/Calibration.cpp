@@ -0,0 +1,206 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "Calibration.h"
+#include <limits>
+#include <mutex>
+
+
+ArrivalRateObjective::ArrivalRateObjective(double window, const vector<double>& observed)
+{
+	_window = window;
+	_observed = observed;
+	_current = 0;
+	_arrivedAtStart = 0;
+	_error = 0;
+}
+
+void ArrivalRateObjective::update(const ImplicitEngine& engine)
+{
+	// close all windows that have been completed by this step
+	while (_current < (int)_observed.size() && engine.getGlobalTime() >= (_current + 1)*_window)
+	{
+		double arrived = engine.getNumArrivedAgents() - _arrivedAtStart;
+		double diff = arrived - _observed[_current];
+		_error += diff*diff;
+		_arrivedAtStart = engine.getNumArrivedAgents();
+		++_current;
+	}
+}
+
+void ArrivalRateObjective::finish(const ImplicitEngine& engine)
+{
+	// nobody arrives after the end of the run
+	for (; _current < (int)_observed.size(); ++_current)
+	{
+		double arrived = engine.getNumArrivedAgents() - _arrivedAtStart;
+		double diff = arrived - _observed[_current];
+		_error += diff*diff;
+		_arrivedAtStart = engine.getNumArrivedAgents();
+	}
+}
+
+
+/**
+* @brief Evaluates the objective of every run while the ensemble runs, and stops the hopeless ones.
+*/
+class Calibration::Observer : public EnsembleObserver
+{
+public:
+	Observer(Calibration& calibration, int noRuns) : _calibration(calibration)
+	{
+		_best = std::numeric_limits<double>::infinity();
+		for (int i = 0; i < noRuns; ++i)
+			_objectives.push_back(calibration._objective.clone());
+		_slowSteps.assign(noRuns, 0);
+	}
+
+	~Observer()
+	{
+		for (size_t i = 0; i < _objectives.size(); ++i)
+			delete _objectives[i];
+	}
+
+	bool stepped(int run, const ImplicitEngine& engine)
+	{
+		CalibrationResult& result = _calibration._results[run];
+		_objectives[run]->update(engine);
+
+		double best;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			best = _best;
+		}
+		if (_objectives[run]->lowerBound() >= best)
+		{
+			result.aborted = true;
+			return false;
+		}
+
+		if (_calibration._stallSteps > 0 && engine.getNumActiveAgents() > 0)
+		{
+			const AgentStore& store = engine.getAgentStore();
+			double speed = 0;
+			for (int i = 0; i < store.size(); ++i)
+				speed += store.velocity(i).norm();
+			speed /= store.size();
+			_slowSteps[run] = speed < _calibration._stallSpeed ? _slowSteps[run] + 1 : 0;
+			if (_slowSteps[run] >= _calibration._stallSteps)
+			{
+				result.stalled = true;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void finished(int run, const ImplicitEngine& engine)
+	{
+		CalibrationResult& result = _calibration._results[run];
+		result.steps = engine.getIterationNumber();
+		// aborted runs keep the value at which they were stopped
+		if (!result.aborted && !result.stalled)
+			_objectives[run]->finish(engine);
+		result.objective = result.stalled ? std::numeric_limits<double>::infinity() : _objectives[run]->value();
+		if (!result.aborted && !result.stalled)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_best = min(_best, result.objective);
+		}
+	}
+
+protected:
+	Calibration& _calibration;
+	/// One objective per run; each is only touched by the thread executing its run
+	vector<CalibrationObjective*> _objectives;
+	/// The number of consecutive slow steps per run
+	vector<int> _slowSteps;
+	/// The best objective of the completed runs
+	double _best;
+	std::mutex _mutex;
+};
+
+
+Calibration::Calibration(const Scenario& scenario, const Parser& baseParameters, const CalibrationObjective& objective)
+	: _baseParameters(baseParameters), _objective(objective), _ensemble(scenario)
+{
+	_stallSpeed = 0.05;
+	_stallSteps = 50;
+}
+
+void Calibration::addRange(const string& key, double min, double max, int samples)
+{
+	Range range;
+	range.key = key;
+	range.min = min;
+	range.max = max;
+	range.samples = std::max(1, samples);
+	_ranges.push_back(range);
+}
+
+int Calibration::run()
+{
+	// enumerate the grid points; the first range varies fastest
+	int noPoints = 1;
+	for (size_t r = 0; r < _ranges.size(); ++r)
+		noPoints *= _ranges[r].samples;
+
+	// the runs of a previous sweep are replaced, so that the runs match the results
+	_results.assign(noPoints, CalibrationResult());
+	_ensemble.clearRuns();
+	for (int point = 0; point < noPoints; ++point)
+	{
+		Parser parameters = _baseParameters;
+		CalibrationResult& result = _results[point];
+		int index = point;
+		for (size_t r = 0; r < _ranges.size(); ++r)
+		{
+			const Range& range = _ranges[r];
+			int sample = index % range.samples;
+			index /= range.samples;
+			double value = range.samples > 1 ? range.min + sample*(range.max - range.min) / (range.samples - 1) : range.min;
+			parameters.setValue(range.key, value);
+			result.values.push_back(value);
+		}
+		result.objective = std::numeric_limits<double>::infinity();
+		result.steps = 0;
+		result.aborted = false;
+		result.stalled = false;
+		// all points share the seed, so that they only differ in their parameters
+		int seed = 23;
+		_baseParameters.getIntValue("seed", seed);
+		_ensemble.addRun(parameters, seed);
+	}
+
+	Observer observer(*this, noPoints);
+	_ensemble.run(&observer);
+
+	int best = -1;
+	for (int point = 0; point < noPoints; ++point)
+	{
+		const CalibrationResult& result = _results[point];
+		if (result.aborted || result.stalled)
+			continue;
+		if (best < 0 || result.objective < _results[best].objective)
+			best = point;
+	}
+	return best;
+}
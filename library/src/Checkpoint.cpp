@@ -0,0 +1,103 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "Checkpoint.h"
+#include <fstream>
+#include <cstdio>
+
+
+void CheckpointWriter::write(const string& s)
+{
+	write((unsigned long long)s.size());
+	_data.append(s);
+}
+
+void CheckpointWriter::write(const vector<Vector2D>& v)
+{
+	write((unsigned long long)v.size());
+	for (size_t i = 0; i < v.size(); ++i)
+		write(v[i]);
+}
+
+void CheckpointWriter::write(const vector<int>& v)
+{
+	write((unsigned long long)v.size());
+	for (size_t i = 0; i < v.size(); ++i)
+		write(v[i]);
+}
+
+bool CheckpointWriter::writeToFile(const string& fileName) const
+{
+	string tmpName = fileName + ".tmp";
+	{
+		std::ofstream output(tmpName, std::ios::binary);
+		if (output.fail())
+			return false;
+		output.write(_data.data(), _data.size());
+		output.close();
+		if (output.fail())
+			return false;
+	}
+	// rename does not overwrite existing files on every platform
+	std::remove(fileName.c_str());
+	return std::rename(tmpName.c_str(), fileName.c_str()) == 0;
+}
+
+bool CheckpointReader::readFromFile(const string& fileName)
+{
+	std::ifstream input(fileName, std::ios::binary);
+	if (input.fail())
+		return false;
+	_data.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+	_pos = 0;
+	_good = !input.bad();
+	return _good;
+}
+
+size_t CheckpointReader::readSize(size_t elementSize)
+{
+	unsigned long long size = 0;
+	read(size);
+	if (_good && size > (_data.size() - _pos) / elementSize)
+		_good = false;
+	return _good ? (size_t)size : 0;
+}
+
+void CheckpointReader::read(string& s)
+{
+	size_t size = readSize(1);
+	s.assign(_data, _pos, size);
+	_pos += size;
+}
+
+void CheckpointReader::read(vector<Vector2D>& v)
+{
+	v.resize(readSize(2 * sizeof(double)));
+	for (size_t i = 0; i < v.size(); ++i)
+		read(v[i]);
+}
+
+void CheckpointReader::read(vector<int>& v)
+{
+	v.resize(readSize(sizeof(int)));
+	for (size_t i = 0; i < v.size(); ++i)
+		read(v[i]);
+}
@@ -0,0 +1,263 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "DistanceField.h"
+#include "Checkpoint.h"
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const unsigned int distanceFieldMagic = 0x46445349; // "ISDF"
+	const unsigned int distanceFieldVersion = 1;
+
+	/// A field in use in this process, baked once by its first user while the others wait for it
+	struct CacheSlot
+	{
+		std::once_flag once;
+		unique_ptr<const DistanceField> field;
+	};
+	/// The slots in use, guarded by the mutex only while they are looked up
+	std::mutex cacheMutex;
+	std::map<unsigned long long, weak_ptr<CacheSlot>> cache;
+}
+
+
+DistanceField::DistanceField()
+{
+	_origin = Vector2D(0, 0);
+	_cellSize = 1;
+	_xNodes = _yNodes = 0;
+	_margin = 0;
+	_hash = 0;
+}
+
+shared_ptr<const DistanceField> DistanceField::obtain(const ObstacleGrid& obstacles, double cellSize, double margin, const string& cacheDirectory)
+{
+	unsigned long long key = hash(obstacles, cellSize, margin);
+	shared_ptr<CacheSlot> slot;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		weak_ptr<CacheSlot>& entry = cache[key];
+		slot = entry.lock();
+		if (!slot)
+		{
+			slot.reset(new CacheSlot());
+			entry = slot;
+		}
+	}
+
+	std::call_once(slot->once, [&]()
+	{
+		DistanceField* field = new DistanceField();
+		slot->field.reset(field);
+		string fileName;
+		if (!cacheDirectory.empty())
+		{
+			std::ostringstream name;
+			name << cacheDirectory << "/distance_" << std::hex << key << ".bin";
+			fileName = name.str();
+		}
+		if (fileName.empty() || !field->load(fileName) || field->_hash != key)
+		{
+			field->bake(obstacles, cellSize, margin);
+			field->_hash = key;
+			if (!fileName.empty() && !field->save(fileName))
+				std::cerr << "Cannot write the distance field cache " << fileName << std::endl;
+		}
+	});
+	// the users share the slot, so that it expires with the last of them
+	return shared_ptr<const DistanceField>(slot, slot->field.get());
+}
+
+unsigned long long DistanceField::hash(const ObstacleGrid& obstacles, double cellSize, double margin)
+{
+	unsigned long long h = hashSeed;
+	hashValue(h, distanceFieldVersion);
+	hashValue(h, cellSize);
+	hashValue(h, margin);
+	const vector<LineObstacle>& segments = obstacles.segments();
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		hashValue(h, segments[i].a.x());
+		hashValue(h, segments[i].a.y());
+		hashValue(h, segments[i].b.x());
+		hashValue(h, segments[i].b.y());
+	}
+	return h;
+}
+
+void DistanceField::bake(const ObstacleGrid& obstacles, double cellSize, double margin)
+{
+	const vector<LineObstacle>& segments = obstacles.segments();
+	_margin = margin;
+	_xNodes = _yNodes = 0;
+	_distance.clear();
+	if (segments.empty())
+		return;
+
+	Vector2D minCorner = segments[0].a;
+	Vector2D maxCorner = segments[0].a;
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		minCorner = minCorner.cwiseMin(segments[i].a).cwiseMin(segments[i].b);
+		maxCorner = maxCorner.cwiseMax(segments[i].a).cwiseMax(segments[i].b);
+	}
+	Vector2D extent = maxCorner - minCorner + Vector2D(2 * margin, 2 * margin);
+
+	// keep the number of samples bounded for large maps
+	const double maxNodes = 1 << 24;
+	_cellSize = cellSize > 0 ? cellSize : 0.1;
+	while ((extent.x() / _cellSize + 2)*(extent.y() / _cellSize + 2) > maxNodes)
+		_cellSize *= 2;
+	_origin = minCorner - Vector2D(margin, margin);
+	_xNodes = (int)ceil(extent.x() / _cellSize) + 1;
+	_yNodes = (int)ceil(extent.y() / _cellSize) + 1;
+
+	// seed the samples around each segment with their exact distance
+	vector<int> closest(_xNodes*_yNodes, -1);
+	vector<double> distance(_xNodes*_yNodes, _margin);
+	const double bandSq = 2.25*_cellSize*_cellSize;
+	for (size_t k = 0; k < segments.size(); ++k)
+	{
+		const LineObstacle& segment = segments[k];
+		int x0 = max(0, (int)floor((min(segment.a.x(), segment.b.x()) - _origin.x()) / _cellSize) - 1);
+		int x1 = min(_xNodes - 1, (int)ceil((max(segment.a.x(), segment.b.x()) - _origin.x()) / _cellSize) + 1);
+		int y0 = max(0, (int)floor((min(segment.a.y(), segment.b.y()) - _origin.y()) / _cellSize) - 1);
+		int y1 = min(_yNodes - 1, (int)ceil((max(segment.a.y(), segment.b.y()) - _origin.y()) / _cellSize) + 1);
+		for (int y = y0; y <= y1; ++y)
+		{
+			for (int x = x0; x <= x1; ++x)
+			{
+				Vector2D node = _origin + Vector2D(x*_cellSize, y*_cellSize);
+				double dSq = (segment.closestPoint(node) - node).squaredNorm();
+				int n = y*_xNodes + x;
+				if (dSq <= bandSq && (closest[n] == -1 || dSq < distance[n] * distance[n]))
+				{
+					closest[n] = (int)k;
+					distance[n] = sqrt(dSq);
+				}
+			}
+		}
+	}
+
+	// propagate the closest segment to the remaining samples, in a forward and a backward raster sweep
+	const int dx[] = { -1, 1, -1, 0 };
+	const int dy[] = { 0, -1, -1, -1 };
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		const int sign = pass == 0 ? 1 : -1;
+		for (int j = 0; j < _yNodes; ++j)
+		{
+			int y = pass == 0 ? j : _yNodes - 1 - j;
+			for (int i = 0; i < _xNodes; ++i)
+			{
+				int x = pass == 0 ? i : _xNodes - 1 - i;
+				int n = y*_xNodes + x;
+				Vector2D node = _origin + Vector2D(x*_cellSize, y*_cellSize);
+				for (int k = 0; k < 4; ++k)
+				{
+					int nx = x + sign*dx[k];
+					int ny = y + sign*dy[k];
+					if (nx < 0 || nx >= _xNodes || ny < 0 || ny >= _yNodes)
+						continue;
+					int candidate = closest[ny*_xNodes + nx];
+					if (candidate == -1 || candidate == closest[n])
+						continue;
+					double d = (segments[candidate].closestPoint(node) - node).norm();
+					if (closest[n] == -1 || d < distance[n])
+					{
+						closest[n] = candidate;
+						distance[n] = d;
+					}
+				}
+			}
+		}
+	}
+
+	_distance.resize(distance.size());
+	for (size_t n = 0; n < distance.size(); ++n)
+		_distance[n] = (float)min(distance[n], _margin);
+}
+
+double DistanceField::distance(const Vector2D& p, Vector2D* gradient) const
+{
+	double fx = (p.x() - _origin.x()) / _cellSize;
+	double fy = (p.y() - _origin.y()) / _cellSize;
+	if (!(fx >= 0 && fy >= 0 && fx < _xNodes - 1 && fy < _yNodes - 1))
+	{
+		if (gradient != NULL)
+			*gradient = Vector2D(0, 0);
+		return _margin;
+	}
+
+	int x = (int)fx;
+	int y = (int)fy;
+	double tx = fx - x;
+	double ty = fy - y;
+	const float* row = &_distance[y*_xNodes + x];
+	double d00 = row[0], d10 = row[1], d01 = row[_xNodes], d11 = row[_xNodes + 1];
+	if (gradient != NULL)
+		*gradient = Vector2D(((1 - ty)*(d10 - d00) + ty*(d11 - d01)) / _cellSize, ((1 - tx)*(d01 - d00) + tx*(d11 - d10)) / _cellSize);
+	return (1 - ty)*((1 - tx)*d00 + tx*d10) + ty*((1 - tx)*d01 + tx*d11);
+}
+
+bool DistanceField::load(const string& fileName)
+{
+	CheckpointReader input;
+	if (!input.readFromFile(fileName))
+		return false;
+	unsigned int magic = 0, version = 0;
+	input.read(magic);
+	input.read(version);
+	if (magic != distanceFieldMagic || version != distanceFieldVersion)
+		return false;
+	input.read(_hash);
+	input.read(_origin);
+	input.read(_cellSize);
+	input.read(_margin);
+	input.read(_xNodes);
+	input.read(_yNodes);
+	if (!input.good() || _xNodes < 0 || _yNodes < 0 || (double)_xNodes*_yNodes > (1 << 26))
+		return false;
+	_distance.resize(_xNodes*_yNodes);
+	input.readArray(_distance.data(), _distance.size());
+	return input.good() && input.atEnd();
+}
+
+bool DistanceField::save(const string& fileName) const
+{
+	CheckpointWriter output;
+	output.write(distanceFieldMagic);
+	output.write(distanceFieldVersion);
+	output.write(_hash);
+	output.write(_origin);
+	output.write(_cellSize);
+	output.write(_margin);
+	output.write(_xNodes);
+	output.write(_yNodes);
+	output.writeArray(_distance.data(), _distance.size());
+	return output.writeToFile(fileName);
+}
@@ -0,0 +1,144 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "DomainDecomposition.h"
+#ifdef IMPLICIT_MPI
+#include <algorithm>
+#include <limits>
+
+DomainDecomposition::DomainDecomposition(MPI_Comm comm)
+{
+	_comm = comm;
+	MPI_Comm_rank(_comm, &_rank);
+	MPI_Comm_size(_comm, &_size);
+	_cuts.assign(_size - 1, numeric_limits<double>::infinity());
+}
+
+int DomainDecomposition::owner(double x) const
+{
+	return (int)(upper_bound(_cuts.begin(), _cuts.end(), x) - _cuts.begin());
+}
+
+void DomainDecomposition::ranksNear(double x, double distance, vector<int>& ranks) const
+{
+	ranks.clear();
+	const int last = owner(x + distance);
+	for (int r = owner(x - distance); r <= last; ++r)
+	{
+		if (r != _rank)
+			ranks.push_back(r);
+	}
+}
+
+void DomainDecomposition::balance(const vector<double>& x)
+{
+	// the extent of all agents
+	double range[] = { numeric_limits<double>::infinity(), numeric_limits<double>::infinity() };
+	for (size_t i = 0; i < x.size(); ++i)
+	{
+		range[0] = std::min(range[0], x[i]);
+		range[1] = std::min(range[1], -x[i]);
+	}
+	MPI_Allreduce(MPI_IN_PLACE, range, 2, MPI_DOUBLE, MPI_MIN, _comm);
+	const double xMin = range[0], xMax = -range[1];
+	if (!(xMin < xMax))
+		return;
+
+	// a histogram of all agents along x, identical on all processes, tells where to cut the world into equal parts
+	vector<long long> histogram(_bins, 0);
+	const double binWidth = (xMax - xMin) / _bins;
+	for (size_t i = 0; i < x.size(); ++i)
+		++histogram[std::min((int)((x[i] - xMin) / binWidth), _bins - 1)];
+	MPI_Allreduce(MPI_IN_PLACE, &histogram[0], _bins, MPI_LONG_LONG, MPI_SUM, _comm);
+	long long total = 0;
+	for (int b = 0; b < _bins; ++b)
+		total += histogram[b];
+
+	long long count = 0;
+	int b = 0;
+	for (int r = 1; r < _size; ++r)
+	{
+		const double target = (double)total * r / _size;
+		while (b < _bins && count + histogram[b] < target)
+			count += histogram[b++];
+		// the cut is interpolated inside its bin
+		double fraction = b < _bins && histogram[b] > 0 ? (target - count) / histogram[b] : 0;
+		_cuts[r - 1] = xMin + (b + fraction)*binWidth;
+	}
+}
+
+double DomainDecomposition::sum(double value) const
+{
+	MPI_Allreduce(MPI_IN_PLACE, &value, 1, MPI_DOUBLE, MPI_SUM, _comm);
+	return value;
+}
+
+double DomainDecomposition::max(double value) const
+{
+	MPI_Allreduce(MPI_IN_PLACE, &value, 1, MPI_DOUBLE, MPI_MAX, _comm);
+	return value;
+}
+
+void DomainDecomposition::exchange(const vector<string>& send, vector<string>& received) const
+{
+	vector<int> sendCounts(_size), receiveCounts(_size), sendOffsets(_size + 1, 0), receiveOffsets(_size + 1, 0);
+	for (int r = 0; r < _size; ++r)
+		sendCounts[r] = (int)send[r].size();
+	MPI_Alltoall(&sendCounts[0], 1, MPI_INT, &receiveCounts[0], 1, MPI_INT, _comm);
+
+	for (int r = 0; r < _size; ++r)
+	{
+		sendOffsets[r + 1] = sendOffsets[r] + sendCounts[r];
+		receiveOffsets[r + 1] = receiveOffsets[r] + receiveCounts[r];
+	}
+	vector<char> sendData(sendOffsets[_size] + 1), receiveData(receiveOffsets[_size] + 1);
+	for (int r = 0; r < _size; ++r)
+		std::copy(send[r].begin(), send[r].end(), sendData.begin() + sendOffsets[r]);
+	MPI_Alltoallv(&sendData[0], &sendCounts[0], &sendOffsets[0], MPI_CHAR, &receiveData[0], &receiveCounts[0], &receiveOffsets[0], MPI_CHAR, _comm);
+
+	received.resize(_size);
+	for (int r = 0; r < _size; ++r)
+		received[r].assign(receiveData.begin() + receiveOffsets[r], receiveData.begin() + receiveOffsets[r + 1]);
+}
+
+void DomainDecomposition::exchange(const vector<vector<double> >& send, vector<vector<double> >& received) const
+{
+	vector<MPI_Request> requests;
+	requests.reserve(2 * _size);
+	for (int r = 0; r < _size; ++r)
+	{
+		if (received[r].empty())
+			continue;
+		requests.push_back(MPI_REQUEST_NULL);
+		MPI_Irecv(&received[r][0], (int)received[r].size(), MPI_DOUBLE, r, 0, _comm, &requests.back());
+	}
+	for (int r = 0; r < _size; ++r)
+	{
+		if (send[r].empty())
+			continue;
+		requests.push_back(MPI_REQUEST_NULL);
+		MPI_Isend(const_cast<double*>(&send[r][0]), (int)send[r].size(), MPI_DOUBLE, r, 0, _comm, &requests.back());
+	}
+	if (!requests.empty())
+		MPI_Waitall((int)requests.size(), &requests[0], MPI_STATUSES_IGNORE);
+}
+
+#endif
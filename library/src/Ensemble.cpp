@@ -0,0 +1,93 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "Ensemble.h"
+#include <atomic>
+#include <thread>
+
+
+Ensemble::Ensemble(const Scenario& scenario) : _scenario(scenario)
+{
+	// small scenes scale best with one thread per run and as many runs as cores
+	_concurrentRuns = max(1, (int)std::thread::hardware_concurrency());
+	_threadsPerRun = 1;
+	_dt = 0.2;
+	_maxSteps = 1000;
+}
+
+int Ensemble::addRun(const Parser& parameters, unsigned int seed)
+{
+	Run run;
+	run.parameters = parameters;
+	run.seed = seed;
+	_runs.push_back(run);
+	return (int)_runs.size() - 1;
+}
+
+void Ensemble::setConcurrency(int concurrentRuns, int threadsPerRun)
+{
+	_concurrentRuns = max(1, concurrentRuns);
+	if (threadsPerRun <= 0)
+		threadsPerRun = (int)std::thread::hardware_concurrency() / _concurrentRuns;
+	_threadsPerRun = max(1, threadsPerRun);
+}
+
+void Ensemble::run(EnsembleObserver* observer)
+{
+	// the workers pull the next pending run until none is left
+	std::atomic<int> next(0);
+	int noWorkers = min(_concurrentRuns, (int)_runs.size());
+	vector<std::thread> workers;
+	for (int w = 0; w < noWorkers; ++w)
+	{
+		workers.push_back(std::thread([this, &next, observer, w]()
+		{
+			int run;
+			while ((run = next++) < (int)_runs.size())
+				runSingle(run, w, observer);
+		}));
+	}
+	for (size_t w = 0; w < workers.size(); ++w)
+		workers[w].join();
+}
+
+void Ensemble::runSingle(int run, int worker, EnsembleObserver* observer)
+{
+	ImplicitEngine engine;
+	engine.setTimeStep(_dt);
+	engine.setMaxSteps(_maxSteps);
+	_scenario.populate(engine);
+	engine.readParameters(_runs[run].parameters);
+	// the ensemble decides on the seed and the thread budget, not the parameter file. Runs with numa=1 pin their threads, so the
+	// workers use disjoint cores
+	engine.setSeed(_runs[run].seed);
+	engine.setNumThreads(_threadsPerRun, worker*_threadsPerRun);
+
+	do
+	{
+		engine.updateSimulation();
+		if (observer != NULL && !observer->stepped(run, engine))
+			break;
+	} while (!engine.endSimulation());
+
+	if (observer != NULL)
+		observer->finished(run, engine);
+}
@@ -26,6 +26,9 @@ ImplicitAgent::ImplicitAgent()
 {
 	_enabled = false;
 	_proximityToken = NULL;
+	_store = NULL;
+	_navigation.reset();
+	_steered = false;
 }
 
 ImplicitAgent::~ImplicitAgent()
@@ -42,69 +45,210 @@ void ImplicitAgent::destroy()
 	}
 }
 
-void ImplicitAgent::init(const AgentInitialParameters& initialConditions, SpatialProximityDatabase *const pd)
+void ImplicitAgent::detach()
 {
-	// initialize the agent based on the initial conditions
+	_position = _store->position(_activeid);
+	_velocity = _store->velocity(_activeid);
+	_vPref = _store->vPref(_activeid);
+}
+
+void ImplicitAgent::disable()
+{
+	detach();
+	_proximityToken->removeFromDatabase();
+	// the field is kept alive by the agents that still follow it
+	_navigation.reset();
+	_enabled = false;
+}
+
+void ImplicitAgent::init(const AgentInitialParameters& initialConditions, SpatialProximityDatabase *const pd, AgentStore *const store)
+{
+	// initialize the agent based on the initial conditions. The agent may be recycled, in which case its token is reused
 	_position = initialConditions.position;
 	_radius = initialConditions.radius;
 	_prefSpeed = initialConditions.prefSpeed;
 	_id = initialConditions.id;
-	_activeid = _id;
 	_gid = initialConditions.gid;
+	_spawnTime = initialConditions.spawnTime;
 	_goalRadiusSq = initialConditions.goalRadius*initialConditions.goalRadius;
 	_velocity = initialConditions.velocity;
+	_vPref = Vector2D(0, 0);
 	_goal = initialConditions.goal;
+	_goalRegion.min = _goalRegion.max = _goal;
+	_navigation.reset();
 	_orientation = (_goal-_position).normalized();
+	_steered = false;
 	_enabled = true;	
 
+	// the dynamic state of the agent lives in the store from now on
+	_store = store;
+	_activeid = _store->add(this, initialConditions);
+
 	//add to the database
-	_proximityToken = pd->allocateToken(this);
+	if (_proximityToken == NULL)
+		_proximityToken = pd->allocateToken(this);
 	// notify proximity database that our position has changed
 	_proximityToken->updateForNewPosition(_position);
 
 	// add initial position, orientation
-	_path.push_back(position());
+	_path.clear();
+	_orientations.clear();
+	_path.push_back(_position);
 	_orientations.push_back(_orientation);
 }
 
+void ImplicitAgent::saveState(CheckpointWriter& output) const
+{
+	output.write(_id);
+	output.write(_gid);
+	output.write(_enabled);
+	output.write(position());
+	output.write(velocity());
+	output.write(vPref());
+	output.write(_goal);
+	output.write(_goalRegion.min);
+	output.write(_goalRegion.max);
+	output.write(_orientation);
+	output.write(_radius);
+	output.write(_prefSpeed);
+	output.write(_goalRadiusSq);
+	output.write(_spawnTime);
+	output.write(_steered);
+	output.write(_path);
+	output.write(_orientations);
+}
+
+void ImplicitAgent::loadState(CheckpointReader& input)
+{
+	bool enabled = false;
+	input.read(_id);
+	input.read(_gid);
+	input.read(enabled);
+	input.read(_position);
+	input.read(_velocity);
+	input.read(_vPref);
+	input.read(_goal);
+	input.read(_goalRegion.min);
+	input.read(_goalRegion.max);
+	input.read(_orientation);
+	input.read(_radius);
+	input.read(_prefSpeed);
+	input.read(_goalRadiusSq);
+	input.read(_spawnTime);
+	input.read(_steered);
+	input.read(_path);
+	input.read(_orientations);
+	// the engine decides which agents go back into the store
+	_enabled = false;
+}
+
+void ImplicitAgent::attach(AgentStore *const store)
+{
+	AgentInitialParameters parameters;
+	parameters.position = _position;
+	parameters.goal = _goal;
+	parameters.velocity = _velocity;
+	parameters.radius = _radius;
+	parameters.prefSpeed = _prefSpeed;
+	parameters.goalRadius = sqrt(_goalRadiusSq);
+	parameters.gid = _gid;
+	parameters.id = _id;
+	parameters.spawnTime = _spawnTime;
+
+	_store = store;
+	_activeid = _store->add(this, parameters);
+	_store->setVPref(_activeid, _vPref);
+	_enabled = true;
+}
+
+void ImplicitAgent::insertIntoDatabase(SpatialProximityDatabase *const pd)
+{
+	if (_proximityToken == NULL)
+		_proximityToken = pd->allocateToken(this);
+	_proximityToken->updateForNewPosition(position());
+}
+
+void ImplicitAgent::setGoal(const Vector2D& goal)
+{
+	_goal = goal;
+	_goalRegion.min = _goalRegion.max = goal;
+	_navigation.reset();
+	if (_enabled)
+		_store->setGoal(_activeid, goal);
+}
 
 void ImplicitAgent::doStep(double dt)
 {
-	_vPref = _goal - _position;
-	double distSqToGoal = _vPref.squaredNorm();
+	Vector2D vPref = _goal - position();
+	double distSqToGoal = vPref.squaredNorm();
 	if (distSqToGoal < _goalRadiusSq)
 	{
-			destroy();
-			_enabled = false;
+			disable();
 			return;
 	}
 
+	// keep the preferred velocity that was set from outside for this step
+	if (_steered)
+	{
+		_steered = false;
+		return;
+	}
+
+	// follow the shortest path around the obstacles, until the goal region is reached or the goal is a step away
+	if (_navigation != NULL && _prefSpeed * dt*_prefSpeed * dt <= distSqToGoal)
+	{
+		Vector2D direction = _navigation->direction(position());
+		if (direction.x() != 0 || direction.y() != 0)
+		{
+			_store->setVPref(_activeid, direction*_prefSpeed);
+			return;
+		}
+	}
+
 	// compute preferred velocity
 	if (_prefSpeed * dt*_prefSpeed * dt > distSqToGoal)
-	  _vPref = _vPref/dt;
+	  vPref = vPref/dt;
 	else 
-	 _vPref *= _prefSpeed / sqrt(distSqToGoal);
+	 vPref *= _prefSpeed / sqrt(distSqToGoal);
+	_store->setVPref(_activeid, vPref);
 }
 
 
 
-void ImplicitAgent::update(double dt)
+void ImplicitAgent::update(double dt, double time, double frameDt)
 {
 	//clamp(_velocity, _maxSpeed);		
-	_position += _velocity * dt;
+	Vector2D velocity = _store->velocity(_activeid);
+	Vector2D oldPosition = _store->position(_activeid);
+	Vector2D oldOrientation = _orientation;
+	Vector2D position = oldPosition + velocity * dt;
+	_store->setPosition(_activeid, position);
 	
 	//simple smoothing of the orientation; there are more elaborate approaches
-	if (_velocity.x() != 0 || _velocity.y() != 0)
-		 _orientation = _orientation + (_velocity.normalized() - _orientation) * 0.4;
+	if (velocity.x() != 0 || velocity.y() != 0)
+		 _orientation = _orientation + (velocity.normalized() - _orientation) * 0.4;
 	
 	// notify proximity database that our position has changed
-	_proximityToken->updateForNewPosition(_position);
-	// add position and orientation to the list
-	_path.push_back(position());
-	_orientations.push_back(_orientation);
+	_proximityToken->updateForNewPosition(position);
+	// add the positions and orientations of the frames that fall in this step, interpolating linearly inside the step
+	double frameTime;
+	while ((frameTime = _spawnTime + _path.size()*frameDt) <= time + 1e-6*dt)
+	{
+		double s = 1 - (time - frameTime) / dt;
+		if (s >= 1 - 1e-6)
+		{
+			_path.push_back(position);
+			_orientations.push_back(_orientation);
+		}
+		else
+		{
+			_path.push_back(oldPosition + (position - oldPosition)*s);
+			_orientations.push_back(oldOrientation + (_orientation - oldOrientation)*s);
+		}
+	}
 }
 
 void ImplicitAgent::findNeighbors(double neighborDist, vector<ProximityDatabaseItem*>& nn)
 {
-	_proximityToken->findNeighbors(_position, neighborDist, nn);
+	_proximityToken->findNeighbors(position(), neighborDist, nn);
 }
\ No newline at end of file
@@ -0,0 +1,351 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "ImplicitCrowdsC.h"
+#include "implicitEngine.h"
+#include "Scenario.h"
+#include <algorithm>
+#include <climits>
+#include <mutex>
+
+/// The state of all agents, indexed by their ids, as published after a step
+struct AgentSnapshot
+{
+	vector<double> positions, velocities, orientations;
+	vector<unsigned char> active;
+	double time;
+	int iteration;
+	int activeAgents;
+	double convergenceGap;
+	bool hitDeadline;
+};
+
+/// Preferred velocities or goals waiting for the next step
+struct PendingValues
+{
+	vector<int> ids;
+	vector<Vector2D> values;
+	void clear() { ids.clear(); values.clear(); }
+};
+
+struct ic_engine
+{
+	ImplicitEngine engine;
+	/// Guards the published snapshot and the pending values
+	mutable std::mutex mutex;
+	/// The snapshot read by the getters, and the one being filled by the simulation thread
+	AgentSnapshot published, back;
+	/// The values queued by the setters, and the ones being applied by the simulation thread
+	PendingValues vPrefs, goals, appliedVPrefs, appliedGoals;
+};
+
+/// Fills the back snapshot from the engine and swaps it in, so the lock is only held for the swap
+static void publish(ic_engine* e)
+{
+	const vector<ImplicitAgent*>& agents = e->engine.getAgents();
+	size_t n = agents.size();
+	AgentSnapshot& s = e->back;
+	s.positions.resize(2 * n);
+	s.velocities.resize(2 * n);
+	s.orientations.resize(2 * n);
+	s.active.resize(n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		const ImplicitAgent* agent = agents[i];
+		if (agent == NULL)
+		{
+			// owned by another process of a distributed run
+			s.positions[2 * i] = s.positions[2 * i + 1] = s.velocities[2 * i] = s.velocities[2 * i + 1] = 0;
+			s.orientations[2 * i] = s.orientations[2 * i + 1] = 0;
+			s.active[i] = 0;
+			continue;
+		}
+		Vector2D p = agent->position(), v = agent->velocity(), o = agent->orientation();
+		s.positions[2 * i] = p.x(); s.positions[2 * i + 1] = p.y();
+		s.velocities[2 * i] = v.x(); s.velocities[2 * i + 1] = v.y();
+		s.orientations[2 * i] = o.x(); s.orientations[2 * i + 1] = o.y();
+		s.active[i] = agent->enabled();
+	}
+	s.time = e->engine.getGlobalTime();
+	s.iteration = e->engine.getIterationNumber();
+	s.activeAgents = e->engine.getNumActiveAgents();
+	s.convergenceGap = e->engine.getConvergenceGap();
+	s.hitDeadline = e->engine.hitDeadline();
+
+	std::lock_guard<std::mutex> lock(e->mutex);
+	std::swap(e->published, e->back);
+}
+
+/// Returns the number of the agents first to first+count-1 that exist, or 0 if the arguments are invalid
+static int clampRange(int agents, int first, int count, const void* buffer)
+{
+	if (buffer == NULL || first < 0 || count <= 0 || first >= agents)
+		return 0;
+	return std::min(count, agents - first);
+}
+
+/// Copies pairs of the published snapshot to a strided buffer
+static int copyPairs(const ic_engine* e, vector<double> AgentSnapshot::*field, int first, int count, double* out, ptrdiff_t stride)
+{
+	if (stride == 0)
+		stride = 2 * sizeof(double);
+	std::lock_guard<std::mutex> lock(e->mutex);
+	const vector<double>& values = e->published.*field;
+	count = clampRange((int)e->published.active.size(), first, count, out);
+	for (int i = 0; i < count; ++i)
+	{
+		double* target = (double*)((char*)out + i*stride);
+		target[0] = values[2 * (first + i)];
+		target[1] = values[2 * (first + i) + 1];
+	}
+	return count;
+}
+
+/// Queues pairs of a strided buffer for the next step
+static int queuePairs(ic_engine* e, PendingValues ic_engine::*pending, int first, int count, const double* in, ptrdiff_t stride)
+{
+	if (stride == 0)
+		stride = 2 * sizeof(double);
+	std::lock_guard<std::mutex> lock(e->mutex);
+	PendingValues& queue = e->*pending;
+	count = clampRange((int)e->published.active.size(), first, count, in);
+	for (int i = 0; i < count; ++i)
+	{
+		const double* source = (const double*)((const char*)in + i*stride);
+		queue.ids.push_back(first + i);
+		queue.values.push_back(Vector2D(source[0], source[1]));
+	}
+	return count;
+}
+
+static ic_engine* createEngine()
+{
+	ic_engine* e = new ic_engine();
+	e->engine.setTimeStep(0.1);
+	e->engine.setMaxSteps(INT_MAX);
+	return e;
+}
+
+ic_engine* ic_create(double width, double height, int xCells, int yCells)
+{
+	ic_engine* e = createEngine();
+	e->engine.init(width, height, xCells, yCells);
+	publish(e);
+	return e;
+}
+
+ic_engine* ic_create_from_scenario(const char* fileName)
+{
+	Scenario scenario;
+	if (fileName == NULL || !scenario.load(fileName))
+		return NULL;
+	ic_engine* e = createEngine();
+	scenario.populate(e->engine);
+	publish(e);
+	return e;
+}
+
+void ic_destroy(ic_engine* engine)
+{
+	delete engine;
+}
+
+ic_status ic_load_parameters(ic_engine* engine, const char* fileName)
+{
+	Parser parser;
+	if (fileName == NULL || !parser.registerParameters(fileName))
+		return IC_ERROR_FILE;
+	engine->engine.readParameters(parser);
+	return IC_OK;
+}
+
+ic_status ic_set_parameter(ic_engine* engine, const char* key, const char* value)
+{
+	if (key == NULL || value == NULL)
+		return IC_ERROR_ARGUMENT;
+	Parser parser;
+	parser.setValue(key, string(value));
+	engine->engine.readParameters(parser);
+	return IC_OK;
+}
+
+void ic_set_time_step(ic_engine* engine, double dt)
+{
+	engine->engine.setTimeStep(dt);
+}
+
+void ic_set_max_steps(ic_engine* engine, int steps)
+{
+	engine->engine.setMaxSteps(steps);
+}
+
+ic_status ic_add_agents(ic_engine* engine, int count, const double* positions, ptrdiff_t positionStride, const double* goals, ptrdiff_t goalStride,
+	const double* prefSpeeds, ptrdiff_t prefSpeedStride, const double* radii, ptrdiff_t radiusStride, int* ids)
+{
+	if (count < 0 || (count > 0 && (positions == NULL || goals == NULL)))
+		return IC_ERROR_ARGUMENT;
+	positionStride = positionStride == 0 ? 2 * sizeof(double) : positionStride;
+	goalStride = goalStride == 0 ? 2 * sizeof(double) : goalStride;
+	prefSpeedStride = prefSpeedStride == 0 ? sizeof(double) : prefSpeedStride;
+	radiusStride = radiusStride == 0 ? sizeof(double) : radiusStride;
+
+	// the defaults are those of the scenario files
+	AgentInitialParameters par;
+	par.velocity = Vector2D(0, 0);
+	par.goalRadius = 1.;
+	par.maxSpeed = 2.;
+	par.gid = 0;
+	engine->engine.reserveAgents(engine->engine.getNumActiveAgents() + count);
+	for (int i = 0; i < count; ++i)
+	{
+		const double* p = (const double*)((const char*)positions + i*positionStride);
+		const double* g = (const double*)((const char*)goals + i*goalStride);
+		par.position = Vector2D(p[0], p[1]);
+		par.goal = Vector2D(g[0], g[1]);
+		par.prefSpeed = prefSpeeds == NULL ? 1.3 : *(const double*)((const char*)prefSpeeds + i*prefSpeedStride);
+		par.radius = radii == NULL ? 0.24 : *(const double*)((const char*)radii + i*radiusStride);
+		engine->engine.addAgent(par);
+		if (ids != NULL)
+			ids[i] = par.id;
+	}
+	publish(engine);
+	return IC_OK;
+}
+
+ic_status ic_add_obstacle(ic_engine* engine, int count, const double* vertices, ptrdiff_t stride)
+{
+	if (count < 2 || vertices == NULL)
+		return IC_ERROR_ARGUMENT;
+	if (stride == 0)
+		stride = 2 * sizeof(double);
+	vector<Vector2D> polygon(count);
+	for (int i = 0; i < count; ++i)
+	{
+		const double* v = (const double*)((const char*)vertices + i*stride);
+		polygon[i] = Vector2D(v[0], v[1]);
+	}
+	engine->engine.addObstacle(polygon);
+	return IC_OK;
+}
+
+int ic_step(ic_engine* engine)
+{
+	ImplicitEngine& simulation = engine->engine;
+	if (simulation.endSimulation())
+		return 0;
+
+	// take the queued values, so that the setters can queue more while stepping
+	{
+		std::lock_guard<std::mutex> lock(engine->mutex);
+		std::swap(engine->goals, engine->appliedGoals);
+		std::swap(engine->vPrefs, engine->appliedVPrefs);
+	}
+	// the goals go first, so that a preferred velocity set together with a goal is kept for this step
+	const PendingValues& goals = engine->appliedGoals;
+	for (size_t i = 0; i < goals.ids.size(); ++i)
+		simulation.getAgent(goals.ids[i])->setGoal(goals.values[i]);
+	const PendingValues& vPrefs = engine->appliedVPrefs;
+	for (size_t i = 0; i < vPrefs.ids.size(); ++i)
+	{
+		ImplicitAgent* agent = simulation.getAgent(vPrefs.ids[i]);
+		if (agent->enabled())
+			agent->steer(vPrefs.values[i]);
+	}
+	engine->appliedGoals.clear();
+	engine->appliedVPrefs.clear();
+
+	simulation.updateSimulation();
+	publish(engine);
+	return 1;
+}
+
+double ic_get_time(const ic_engine* engine)
+{
+	std::lock_guard<std::mutex> lock(engine->mutex);
+	return engine->published.time;
+}
+
+int ic_get_iteration(const ic_engine* engine)
+{
+	std::lock_guard<std::mutex> lock(engine->mutex);
+	return engine->published.iteration;
+}
+
+int ic_get_num_agents(const ic_engine* engine)
+{
+	std::lock_guard<std::mutex> lock(engine->mutex);
+	return (int)engine->published.active.size();
+}
+
+int ic_get_num_active_agents(const ic_engine* engine)
+{
+	std::lock_guard<std::mutex> lock(engine->mutex);
+	return engine->published.activeAgents;
+}
+
+double ic_get_convergence_gap(const ic_engine* engine)
+{
+	std::lock_guard<std::mutex> lock(engine->mutex);
+	return engine->published.convergenceGap;
+}
+
+int ic_get_hit_deadline(const ic_engine* engine)
+{
+	std::lock_guard<std::mutex> lock(engine->mutex);
+	return engine->published.hitDeadline ? 1 : 0;
+}
+
+int ic_get_positions(const ic_engine* engine, int first, int count, double* positions, ptrdiff_t stride)
+{
+	return copyPairs(engine, &AgentSnapshot::positions, first, count, positions, stride);
+}
+
+int ic_get_velocities(const ic_engine* engine, int first, int count, double* velocities, ptrdiff_t stride)
+{
+	return copyPairs(engine, &AgentSnapshot::velocities, first, count, velocities, stride);
+}
+
+int ic_get_orientations(const ic_engine* engine, int first, int count, double* orientations, ptrdiff_t stride)
+{
+	return copyPairs(engine, &AgentSnapshot::orientations, first, count, orientations, stride);
+}
+
+int ic_get_active(const ic_engine* engine, int first, int count, unsigned char* active, ptrdiff_t stride)
+{
+	if (stride == 0)
+		stride = 1;
+	std::lock_guard<std::mutex> lock(engine->mutex);
+	const vector<unsigned char>& values = engine->published.active;
+	count = clampRange((int)values.size(), first, count, active);
+	for (int i = 0; i < count; ++i)
+		active[i*stride] = values[first + i];
+	return count;
+}
+
+int ic_set_preferred_velocities(ic_engine* engine, int first, int count, const double* velocities, ptrdiff_t stride)
+{
+	return queuePairs(engine, &ic_engine::vPrefs, first, count, velocities, stride);
+}
+
+int ic_set_goals(ic_engine* engine, int first, int count, const double* goals, ptrdiff_t stride)
+{
+	return queuePairs(engine, &ic_engine::goals, first, count, goals, stride);
+}
@@ -20,22 +20,72 @@
 // Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
 
 
-#include "ImplicitEngine.h"
+#include "implicitEngine.h"
+#include "Trace.h"
 #include <omp.h>
 #include <algorithm>
+#include <random>
+#include <atomic>
+#include <sstream>
+#include <iostream>
+#include <climits>
+#include <cassert>
+#include <limits>
 
 
-#define _INFTY 9e9
+const unsigned int ImplicitEngine::_checkpointMagic;
+const unsigned int ImplicitEngine::_checkpointVersion;
 
 ImplicitEngine::ImplicitEngine()
 {
 	_spatialDatabase = NULL;
 	_max_threads = omp_get_max_threads();
+	_firstCore = 0;
+	_seed = 23; // fixed seed to compare some results 
 	_noAgents = 0;
+	_noArrived = 0;
+	_activeAgents = 0;
+	_reachedGoals = false;
+	_recycleAgents = false;
+	_deterministic = false;
+	_numaAware = false;
+	_hugePages = false;
+	_placedCapacity = -1;
+	_spatialOrder = InsertionOrder;
+	_reorderInterval = 20;
+	_optimizer = LBFGSOptimizer;
+	_solveBudget = 0;
+	_deadline = 0;
+	_timedOut = _hitDeadline = false;
+	_stepNorm = _convergenceGap = 0;
+	_bestEnergy = _INFTY;
+	_levelOfDetail = false;
+	_adaptiveTimeStep = false;
+	_minTimeStep = 0.05;
+	_maxTimeStep = 0.5;
+	_lastWorkRate = 0;
+	_timeStepFactor = 1.25;
+	_frameDt = 0;
+	_multiRate = 1;
+	_denseNeighbors = 8;
+	_solverIterations = _solverInfeasible = 0;
+	_chunkAgents = -1;
+	_maxRadius = 0;
+	_checkpointWritten = true;
+	_distanceFieldCellSize = 0;
+	_navigationCellSize = 0;
+	_navigationClearance = 0.3;
+	_stats.reset(0, 0);
+#ifdef IMPLICIT_MPI
+	_domain = NULL;
+	_balanceInterval = 50;
+	_ghostBegin = INT_MAX;
+#endif
 }
 
 ImplicitEngine::~ImplicitEngine()
 {
+	waitForCheckpoint();
 
 	for (vector<ImplicitAgent*>::iterator it = _agents.begin(); it != _agents.end(); ++it)
 	{
@@ -44,6 +94,12 @@ ImplicitEngine::~ImplicitEngine()
 
 	}
 
+#ifdef IMPLICIT_MPI
+	for (size_t i = 0; i < _ghostPool.size(); ++i)
+		delete _ghostPool[i];
+	delete _domain;
+#endif
+
 	if (_spatialDatabase != NULL)
 	{
 		delete _spatialDatabase;
@@ -53,7 +109,7 @@ ImplicitEngine::~ImplicitEngine()
 
 void ImplicitEngine::init(double xRange, double yRange, int xCells, int yCells)
 {
-	srand(23); // fixed seed to compare some results 
+	_rng.seed(_seed);
 	_iteration = 0;
 	_globalTime = 0;
 	_spatialDatabase = new SpatialProximityDatabase(VectorXd::Zero(2, 1), Vector2D(xRange, yRange), Vector2D(xCells, yCells));
@@ -84,6 +140,39 @@ void ImplicitEngine::readParameters(const Parser& parser)
 	parser.getIntValue("newtonIter", _newtonIter);
 	parser.getIntValue("lbfgsWindow", _window);
 	parser.getDoubleValue("eps_x", _eps_x);
+	string optimizer;
+	if (parser.getStringValue("optimizer", optimizer))
+		_optimizer = optimizer == "nesterov" ? NesterovOptimizer : optimizer == "anderson" ? AndersonOptimizer : optimizer == "cg" ? ConjugateGradientOptimizer :
+			optimizer == "gradient" ? AcceleratedGradientOptimizer : LBFGSOptimizer;
+	parser.getDoubleValue("solveBudget", _solveBudget);
+	_solveBudget = max(_solveBudget, 0.0);
+	parser.getBoolValue("recycleAgents", _recycleAgents);
+	parser.getBoolValue("deterministic", _deterministic);
+	parser.getBoolValue("numa", _numaAware);
+	parser.getBoolValue("hugePages", _hugePages);
+	string spatialOrder;
+	if (parser.getStringValue("spatialOrder", spatialOrder))
+		_spatialOrder = spatialOrder == "hilbert" ? HilbertOrder : spatialOrder == "morton" ? MortonOrder : InsertionOrder;
+	parser.getIntValue("reorderInterval", _reorderInterval);
+	_reorderInterval = max(_reorderInterval, 1);
+	parser.getBoolValue("levelOfDetail", _levelOfDetail);
+	parser.getBoolValue("adaptiveTimeStep", _adaptiveTimeStep);
+	parser.getDoubleValue("minTimeStep", _minTimeStep);
+	parser.getDoubleValue("maxTimeStep", _maxTimeStep);
+	parser.getIntValue("multiRate", _multiRate);
+	parser.getIntValue("multiRateNeighbors", _denseNeighbors);
+	_multiRate = max(_multiRate, 1);
+	parser.getDoubleValue("distanceField", _distanceFieldCellSize);
+	parser.getStringValue("distanceFieldCache", _distanceFieldCache);
+	parser.getDoubleValue("navigationField", _navigationCellSize);
+	parser.getDoubleValue("navigationClearance", _navigationClearance);
+	parser.getStringValue("navigationFieldCache", _navigationCache);
+	int threads;
+	if (parser.getIntValue("threads", threads))
+		setNumThreads(threads);
+	int seed;
+	if (parser.getIntValue("seed", seed))
+		setSeed(seed);
 }
 
 bool ImplicitEngine::endSimulation()
@@ -98,352 +187,1306 @@ void ImplicitEngine::draw()
 
 void ImplicitEngine::addAgent(AgentInitialParameters& agentConditions)
 {
-	ImplicitAgent* newAgent = new ImplicitAgent();
-	if (newAgent != NULL) {
-	    agentConditions.id = _noAgents;
-		newAgent->init(agentConditions , _spatialDatabase);
+	ImplicitAgent* newAgent;
+	if (!_agentPool.empty())
+	{
+		// reuse an agent that has left the simulation, together with its proximity token
+		newAgent = _agentPool.back();
+		_agentPool.pop_back();
+		agentConditions.id = newAgent->id();
+	}
+	else
+	{
+		newAgent = new ImplicitAgent();
+		agentConditions.id = _noAgents;
 		_agents.push_back(newAgent);
 		++_noAgents;
 	}
+	agentConditions.spawnTime = _globalTime;
+	newAgent->init(agentConditions, _spatialDatabase, &_store);
+	_maxRadius = max(_maxRadius, agentConditions.radius);
+}
+
+void ImplicitEngine::addSource(const SpawnSource& source)
+{
+	_sources.push_back(source);
+	_pendingSpawns.push_back(0.);
+}
+
+void ImplicitEngine::addObstacle(const vector<Vector2D>& vertices)
+{
+	if (vertices.size() == 2)
+		_obstacles.addSegment(vertices[0], vertices[1]);
+	else
+		_obstacles.addPolygon(vertices);
 }
 
 
 void ImplicitEngine::updateSimulation()
 {
-	_reachedGoals = true;
-	_activeAgents = 0;
+	TRACE_SCOPE("updateSimulation");
+	STATS(_stats.reset(_iteration, _globalTime));
+	STATS(_stats.timeStep = _dt);
+	// the paths keep the sampling of the first step, whatever the time step becomes
+	if (_frameDt <= 0)
+		_frameDt = _dt;
+	_solverIterations = _solverInfeasible = 0;
+	// the budget covers the whole step, so the solver gets what the other phases leave
+	_deadline = _solveBudget > 0 ? omp_get_wtime() + 1e-3*_solveBudget : 0;
+	_hitDeadline = false;
+	_convergenceGap = 0;
+	// the threads of the engine are started by the first step, once its thread budget is known
+	_pool.resize(_max_threads, _numaAware, _firstCore);
+	STATS(double phaseStart = omp_get_wtime());
+	// the obstacles are binned once, after all of them have been added, and baked into a distance field if requested
+	if (!_obstacles.isBuilt())
+	{
+		_obstacles.build(0.5*_neighborDist);
+		_distanceField.reset();
+		// the agents look their fields up again around the new obstacles
+		_navigationFields.clear();
+		for (int i = 0; i < _store.size(); ++i)
+			_store.agent(i)->setNavigationField(NULL);
+	}
+	if (!_distanceField && _distanceFieldCellSize > 0 && !_obstacles.empty())
+	{
+		TRACE_SCOPE("bakeDistanceField");
+		_distanceField = DistanceField::obtain(_obstacles, _distanceFieldCellSize, _neighborDist, _distanceFieldCache);
+	}
+	spawnAgents();
 
-	for (unsigned int i = 0; i < _noAgents; ++i)
+	int arrived = 0;
 	{
-		_agents[i]->doStep(_dt);
-		if (_agents[i]->enabled())
+		TRACE_SCOPE("doStep");
+		// iterate backwards so that swapping an arrived agent with the last active one never skips an agent
+		for (int i = _store.size() - 1; i >= 0; --i)
 		{
-			_reachedGoals = false;
-			++_activeAgents;
+			ImplicitAgent* agent = _store.agent(i);
+			if (agent->navigationField() == NULL && _navigationCellSize > 0)
+				agent->setNavigationField(navigationField(agent->goalRegion()));
+			agent->doStep(_dt);
+			if (agent->enabled() && insideSink(agent->position()))
+				agent->disable();
+			if (!agent->enabled())
+			{
+				removeActiveAgent(i);
+				++arrived;
+				if (_recycleAgents)
+					_agentPool.push_back(agent);
+			}
 		}
 	}
+	// the processes of a distributed run count the agents that left any of them, so that they all report the same number
+	DISTRIBUTED(if (_domain != NULL) arrived = (int)globalSum(arrived));
+	_noArrived += arrived;
+	_activeAgents = _store.size();
+	_reachedGoals = _activeAgents == 0 && !sourcesPending();
+	DISTRIBUTED(if (_domain != NULL) _reachedGoals = globalSum(_activeAgents) == 0);
+	STATS(_stats.activeAgents = _activeAgents);
+	STATS(_stats.doStepTime = omp_get_wtime() - phaseStart);
 
 	if (_reachedGoals) return;
 
-	this->initializeProblem();
-	this->minimize(_vNew);
-	this->finalizeProblem();
-
-	for (unsigned int i = 0; i < _noAgents; ++i)
+	// the world can be empty while waiting for the sources, while every process of a distributed run takes part in the solve
+	bool solve = _activeAgents > 0;
+	DISTRIBUTED(solve = solve || _domain != NULL);
+	if (solve)
 	{
-		if (_agents[i]->enabled())
-			_agents[i]->update(_dt);
+		STATS(phaseStart = omp_get_wtime());
+		if (_numaAware || _spatialOrder != InsertionOrder)
+			arrangeAgents();
+		DISTRIBUTED(if (_domain != NULL) exchangeGhosts());
+		this->initializeProblem();
+		STATS(_stats.neighborTime = omp_get_wtime() - phaseStart);
+		STATS(phaseStart = omp_get_wtime());
+		// the rate classes are not coordinated across the processes of a distributed run
+		bool multiRate = _multiRate > 1;
+		DISTRIBUTED(multiRate = multiRate && _domain == NULL);
+		if (multiRate)
+		{
+			// the agents are updated after every sub-step
+			this->solveMultiRate();
+			STATS(_stats.solveTime = omp_get_wtime() - phaseStart);
+		}
+		else
+		{
+			if (globalSum(_activeAgents) > 0)
+				this->minimize(_work.vNew);
+			STATS(_stats.solveTime = omp_get_wtime() - phaseStart);
+			STATS(phaseStart = omp_get_wtime());
+			this->finalizeProblem();
+			DISTRIBUTED(if (_domain != NULL) removeGhosts());
+
+			TRACE_SCOPE("update");
+			for (int i = 0; i < _store.size(); ++i)
+				_store.agent(i)->update(_dt, _globalTime + _dt, _frameDt);
+			STATS(_stats.updateTime = omp_get_wtime() - phaseStart);
+		}
 	}
 
+	DISTRIBUTED(if (_domain != NULL) migrateAgents((_iteration + 1) % _balanceInterval == 0));
+	STATS(_statsHistory.push_back(_stats));
 	_globalTime += _dt;
 	_iteration++;
+	if (_adaptiveTimeStep)
+		adaptTimeStep();
+	// hand the completed trace chunks to the file, while no thread of this engine is recording
+	TRACE(Trace::flush());
 }
 
+void ImplicitEngine::removeActiveAgent(int activeID)
+{
+	// the store swaps in the last active agent, so that the slots stay compacted without rescanning
+	_store.remove(activeID);
+}
 
-void ImplicitEngine::initializeProblem()
+void ImplicitEngine::spawnAgents()
 {
-	_noVars = _activeAgents + _activeAgents;
-	_pos.resize(_noVars);
-	_vel.resize(_noVars);
-	_vGoal.resize(_noVars);
-	_radius.resize(_activeAgents);
-	_nn.resize(_activeAgents);
-	//initial optimal velocity is zero to guarantee collision-freeness
-	_vNew = VectorXd::Zero(_noVars);
+	TRACE_SCOPE("spawnAgents");
+	AgentInitialParameters par;
+	par.velocity = Vector2D(0, 0); // spawned agents start at rest
+	par.maxSpeed = 2.;
 
-	int counter = 0;
-	for (unsigned int i = 0; i < _noAgents; ++i)
+	for (size_t s = 0; s < _sources.size(); ++s)
 	{
-		if (_agents[i]->enabled())
+		const SpawnSource& source = _sources[s];
+		if (_globalTime < source.startTime || _globalTime >= source.endTime)
+			continue;
+
+		par.prefSpeed = source.prefSpeed;
+		par.radius = source.radius;
+		par.goalRadius = source.goalRadius;
+		par.gid = source.gid;
+		_pendingSpawns[s] += source.rate*_dt;
+		while (_pendingSpawns[s] >= 1.)
 		{
-			size_t id_y = counter + _activeAgents;
-			_pos[counter] = _agents[i]->position().x();
-			_pos[id_y] = _agents[i]->position().y();
-			_vel[counter] = _agents[i]->velocity().x();
-			_vel[id_y] = _agents[i]->velocity().y();
-			_vGoal[counter] = _agents[i]->vPref().x();
-			_vGoal[id_y] = _agents[i]->vPref().y();
-			_radius[counter] = _agents[i]->radius();
-			_agents[i]->setActiveID(counter);
-			_nn[counter].clear();
-			// precompute NN 
-			_agents[i]->findNeighbors(_neighborDist, _nn[counter]);
-			++counter;
+			// try a few random positions; if the region is congested, the agent is spawned in a later step
+			bool spawned = false;
+			for (int attempt = 0; attempt < 10 && !spawned; ++attempt)
+			{
+				par.position = randomPoint(source.region);
+				if (isFree(par.position, par.radius))
+				{
+					par.goal = randomPoint(source.goalRegion);
+					addAgent(par);
+					_agents[par.id]->setGoalRegion(source.goalRegion);
+					spawned = true;
+				}
+			}
+			if (!spawned)
+				break;
+			_pendingSpawns[s] -= 1.;
 		}
 	}
 }
 
-void ImplicitEngine::finalizeProblem()
+bool ImplicitEngine::isFree(const Vector2D& position, double radius)
+{
+	_spawnNeighbors.clear();
+	_spatialDatabase->findNeighbors(position, radius + _maxRadius, _spawnNeighbors);
+	for (size_t j = 0; j < _spawnNeighbors.size(); ++j)
+	{
+		const ImplicitAgent* other = static_cast<ImplicitAgent*>(_spawnNeighbors[j]);
+		double minDist = radius + other->radius();
+		if ((other->position() - position).squaredNorm() < minDist*minDist)
+			return false;
+	}
+	_obstacles.query(position, radius, _spawnObstacles);
+	return _spawnObstacles.empty();
+}
+
+bool ImplicitEngine::insideSink(const Vector2D& position) const
+{
+	for (size_t s = 0; s < _sinks.size(); ++s)
+	{
+		if (_sinks[s].contains(position))
+			return true;
+	}
+	return false;
+}
+
+bool ImplicitEngine::sourcesPending() const
+{
+	for (size_t s = 0; s < _sources.size(); ++s)
+	{
+		if (_sources[s].endTime > _globalTime)
+			return true;
+	}
+	return false;
+}
+
+int ImplicitEngine::getMaxSpawns() const
+{
+	// the same test and accumulation as in spawnAgents, without spawning
+	int count = 0;
+	for (size_t s = 0; s < _sources.size(); ++s)
+	{
+		if (_globalTime >= _sources[s].startTime && _globalTime < _sources[s].endTime)
+			count += (int)floor(_pendingSpawns[s] + _sources[s].rate*_dt);
+	}
+	return count;
+}
+
+void ImplicitEngine::setSeed(unsigned int seed)
+{
+	_seed = seed;
+	_rng.seed(_seed);
+}
+
+void ImplicitEngine::setNumThreads(int threads, int firstCore)
+{
+	_max_threads = threads > 0 ? threads : omp_get_max_threads();
+	_firstCore = firstCore;
+}
+
+void ImplicitEngine::saveCheckpoint(const string& fileName)
+{
+	TRACE_SCOPE("saveCheckpoint");
+	// only one checkpoint is written at a time
+	waitForCheckpoint();
+	if (_spatialDatabase == NULL)
+	{
+		std::cerr << "Cannot save a checkpoint of an engine that has not been initialized" << std::endl;
+		_checkpointWritten = false;
+		return;
+	}
+#ifdef IMPLICIT_MPI
+	if (_domain != NULL)
+	{
+		std::cerr << "Checkpoints of distributed runs are not supported" << std::endl;
+		_checkpointWritten = false;
+		return;
+	}
+#endif
+
+	CheckpointWriter output;
+	output.write(_checkpointMagic);
+	output.write(_checkpointVersion);
+
+	// simulation state and parameters
+	output.write(_dt);
+	output.write(_globalTime);
+	output.write(_iteration);
+	output.write(_maxSteps);
+	output.write(_reachedGoals);
+	output.write(_noArrived);
+	output.write(_maxRadius);
+	output.write(_recycleAgents);
+	output.write(_deterministic);
+	output.write(_numaAware);
+	output.write(_hugePages);
+	output.write(_spatialOrder);
+	output.write(_reorderInterval);
+	output.write(_levelOfDetail);
+	output.write(_adaptiveTimeStep);
+	output.write(_minTimeStep);
+	output.write(_maxTimeStep);
+	output.write(_lastWorkRate);
+	output.write(_timeStepFactor);
+	output.write(_frameDt);
+	output.write(_multiRate);
+	output.write(_denseNeighbors);
+	output.write(_seed);
+	output.write(_k);
+	output.write(_p);
+	output.write(_t0);
+	output.write(_eps);
+	output.write(_ksi);
+	output.write(_eta);
+	output.write(_neighborDist);
+	output.write(_newtonIter);
+	output.write(_eps_x);
+	output.write(_window);
+	output.write(_optimizer);
+	output.write(_solveBudget);
+	std::ostringstream rngState;
+	rngState << _rng;
+	output.write(rngState.str());
+
+	// the environment and its static geometry
+	output.write(_spatialDatabase->getOrigin());
+	output.write(_spatialDatabase->getDimensions());
+	output.write(_spatialDatabase->getDivisions());
+	output.write((unsigned long long)_sources.size());
+	for (size_t s = 0; s < _sources.size(); ++s)
+	{
+		const SpawnSource& source = _sources[s];
+		output.write(source.startTime);
+		output.write(source.endTime);
+		output.write(source.rate);
+		output.write(source.region.min);
+		output.write(source.region.max);
+		output.write(source.goalRegion.min);
+		output.write(source.goalRegion.max);
+		output.write(source.prefSpeed);
+		output.write(source.radius);
+		output.write(source.goalRadius);
+		output.write(source.gid);
+		output.write(_pendingSpawns[s]);
+	}
+	output.write((unsigned long long)_sinks.size());
+	for (size_t s = 0; s < _sinks.size(); ++s)
+	{
+		output.write(_sinks[s].min);
+		output.write(_sinks[s].max);
+	}
+	output.write(_distanceFieldCellSize);
+	output.write(_distanceFieldCache);
+	output.write(_navigationCellSize);
+	output.write(_navigationClearance);
+	output.write(_navigationCache);
+	const vector<LineObstacle>& obstacles = _obstacles.segments();
+	output.write((unsigned long long)obstacles.size());
+	for (size_t k = 0; k < obstacles.size(); ++k)
+	{
+		output.write(obstacles[k].a);
+		output.write(obstacles[k].b);
+	}
+
+	// the agents, followed by the order of the active agents in the store and in the bins of the proximity database.
+	// Both orders determine the order in which the energy is summed, so keeping them makes a restored run identical to an uninterrupted one
+	output.write((unsigned long long)_agents.size());
+	for (size_t i = 0; i < _agents.size(); ++i)
+		_agents[i]->saveState(output);
+	vector<int> ids(_store.size());
+	for (int i = 0; i < _store.size(); ++i)
+		ids[i] = _store.agent(i)->id();
+	output.write(ids);
+	vector<ProximityDatabaseItem*> items;
+	_spatialDatabase->getAllObjects(items);
+	ids.resize(items.size());
+	for (size_t i = 0; i < items.size(); ++i)
+		ids[i] = static_cast<ImplicitAgent*>(items[i])->id();
+	output.write(ids);
+	ids.resize(_agentPool.size());
+	for (size_t i = 0; i < _agentPool.size(); ++i)
+		ids[i] = _agentPool[i]->id();
+	output.write(ids);
+
+	// the state has been copied, the disk is left to a background thread
+	_checkpointWriter = std::thread([this, fileName](const CheckpointWriter& data)
+	{
+		_checkpointWritten = data.writeToFile(fileName);
+		if (!_checkpointWritten)
+			std::cerr << "Cannot write checkpoint file " << fileName << std::endl;
+	}, std::move(output));
+}
+
+bool ImplicitEngine::waitForCheckpoint()
+{
+	if (_checkpointWriter.joinable())
+		_checkpointWriter.join();
+	return _checkpointWritten;
+}
+
+bool ImplicitEngine::loadCheckpoint(const string& fileName)
+{
+	if (!_agents.empty() || !_obstacles.empty() || _spatialDatabase != NULL)
+	{
+		std::cerr << "Checkpoints can only be loaded into a new engine" << std::endl;
+		return false;
+	}
+
+	CheckpointReader input;
+	if (!input.readFromFile(fileName))
+	{
+		std::cerr << "Cannot read checkpoint file " << fileName << std::endl;
+		return false;
+	}
+	unsigned int magic = 0, version = 0;
+	input.read(magic);
+	input.read(version);
+	if (magic != _checkpointMagic || version != _checkpointVersion)
+	{
+		std::cerr << fileName << " is not a checkpoint, or was written by a different version" << std::endl;
+		return false;
+	}
+
+	input.read(_dt);
+	input.read(_globalTime);
+	input.read(_iteration);
+	input.read(_maxSteps);
+	input.read(_reachedGoals);
+	input.read(_noArrived);
+	input.read(_maxRadius);
+	input.read(_recycleAgents);
+	input.read(_deterministic);
+	input.read(_numaAware);
+	input.read(_hugePages);
+	input.read(_spatialOrder);
+	input.read(_reorderInterval);
+	input.read(_levelOfDetail);
+	input.read(_adaptiveTimeStep);
+	input.read(_minTimeStep);
+	input.read(_maxTimeStep);
+	input.read(_lastWorkRate);
+	input.read(_timeStepFactor);
+	input.read(_frameDt);
+	input.read(_multiRate);
+	input.read(_denseNeighbors);
+	input.read(_seed);
+	input.read(_k);
+	input.read(_p);
+	input.read(_t0);
+	input.read(_eps);
+	input.read(_ksi);
+	input.read(_eta);
+	input.read(_neighborDist);
+	input.read(_newtonIter);
+	input.read(_eps_x);
+	input.read(_window);
+	input.read(_optimizer);
+	input.read(_solveBudget);
+	string rngState;
+	input.read(rngState);
+
+	Vector2D origin, dimensions, divisions;
+	input.read(origin);
+	input.read(dimensions);
+	input.read(divisions);
+	vector<SpawnSource> sources(input.readSize(sizeof(double)));
+	vector<double> pendingSpawns(sources.size());
+	for (size_t s = 0; s < sources.size(); ++s)
+	{
+		SpawnSource& source = sources[s];
+		input.read(source.startTime);
+		input.read(source.endTime);
+		input.read(source.rate);
+		input.read(source.region.min);
+		input.read(source.region.max);
+		input.read(source.goalRegion.min);
+		input.read(source.goalRegion.max);
+		input.read(source.prefSpeed);
+		input.read(source.radius);
+		input.read(source.goalRadius);
+		input.read(source.gid);
+		input.read(pendingSpawns[s]);
+	}
+	vector<SpawnRegion> sinks(input.readSize(sizeof(double)));
+	for (size_t s = 0; s < sinks.size(); ++s)
+	{
+		input.read(sinks[s].min);
+		input.read(sinks[s].max);
+	}
+	input.read(_distanceFieldCellSize);
+	input.read(_distanceFieldCache);
+	input.read(_navigationCellSize);
+	input.read(_navigationClearance);
+	input.read(_navigationCache);
+	vector<LineObstacle> obstacles(input.readSize(4 * sizeof(double)));
+	for (size_t k = 0; k < obstacles.size(); ++k)
+	{
+		input.read(obstacles[k].a);
+		input.read(obstacles[k].b);
+	}
+
+	vector<ImplicitAgent*> agents(input.readSize(sizeof(int)));
+	for (size_t i = 0; i < agents.size(); ++i)
+	{
+		agents[i] = new ImplicitAgent();
+		agents[i]->loadState(input);
+	}
+	vector<int> storeOrder, binOrder, pool;
+	input.read(storeOrder);
+	input.read(binOrder);
+	input.read(pool);
+	std::istringstream rngInput(rngState);
+	rngInput >> _rng;
+
+	// every active agent has to be in the database exactly once, and no pooled agent can be active
+	bool valid = input.good() && input.atEnd() && !rngInput.fail() && binOrder.size() == storeOrder.size();
+	vector<int> state(agents.size(), 0);
+	for (size_t i = 0; valid && i < agents.size(); ++i)
+		valid = agents[i]->id() == (int)i;
+	for (size_t i = 0; valid && i < storeOrder.size(); ++i)
+		valid = storeOrder[i] >= 0 && storeOrder[i] < (int)agents.size() && state[storeOrder[i]]++ == 0;
+	for (size_t i = 0; valid && i < binOrder.size(); ++i)
+		valid = binOrder[i] >= 0 && binOrder[i] < (int)agents.size() && state[binOrder[i]]++ == 1;
+	for (size_t i = 0; valid && i < pool.size(); ++i)
+		valid = pool[i] >= 0 && pool[i] < (int)agents.size() && state[pool[i]]++ == 0;
+	if (!valid)
+	{
+		std::cerr << "Checkpoint file " << fileName << " is corrupted" << std::endl;
+		for (size_t i = 0; i < agents.size(); ++i)
+			delete agents[i];
+		return false;
+	}
+
+	// rebuild the store and the proximity database in bulk. The bins are linked lists that grow at the front,
+	// so inserting the agents in the reverse order of the traversal restores every bin as it was
+	_spatialDatabase = new SpatialProximityDatabase(origin + dimensions*0.5, dimensions, divisions);
+	_store.reserve((int)storeOrder.size());
+	for (size_t i = 0; i < storeOrder.size(); ++i)
+		agents[storeOrder[i]]->attach(&_store);
+	for (size_t i = binOrder.size(); i-- > 0;)
+		agents[binOrder[i]]->insertIntoDatabase(_spatialDatabase);
+
+	_agents = agents;
+	_noAgents = (unsigned int)agents.size();
+	_agentPool.clear();
+	for (size_t i = 0; i < pool.size(); ++i)
+		_agentPool.push_back(agents[pool[i]]);
+	_sources = sources;
+	_pendingSpawns = pendingSpawns;
+	_sinks = sinks;
+	for (size_t k = 0; k < obstacles.size(); ++k)
+		_obstacles.addSegment(obstacles[k].a, obstacles[k].b);
+	_activeAgents = _store.size();
+	_stats.reset(_iteration, _globalTime);
+	return true;
+}
+
+shared_ptr<const NavigationField> ImplicitEngine::navigationField(const SpawnRegion& goal)
+{
+	if (_navigationCellSize <= 0 || _obstacles.empty())
+		return NULL;
+	array<double, 4> key = { { goal.min.x(), goal.min.y(), goal.max.x(), goal.max.y() } };
+	map<array<double, 4>, weak_ptr<const NavigationField>>::iterator it = _navigationFields.find(key);
+	if (it != _navigationFields.end())
+	{
+		shared_ptr<const NavigationField> field = it->second.lock();
+		if (field)
+			return field;
+	}
+
+	// the field covers the environment and the goal region
+	TRACE_SCOPE("navigationField");
+	SpawnRegion extent;
+	extent.min = _spatialDatabase->getOrigin();
+	extent.max = extent.min + _spatialDatabase->getDimensions();
+	extent.min = extent.min.cwiseMin(goal.min) - Vector2D(1, 1);
+	extent.max = extent.max.cwiseMax(goal.max) + Vector2D(1, 1);
+	shared_ptr<const NavigationField> field = NavigationField::obtain(_obstacles, goal, extent, _navigationCellSize, _navigationClearance, _navigationCache, _pool);
+	// forget the fields that no agent follows any more, e.g. those of point goals set from outside
+	for (it = _navigationFields.begin(); it != _navigationFields.end();)
+	{
+		if (it->second.expired())
+			it = _navigationFields.erase(it);
+		else
+			++it;
+	}
+	_navigationFields[key] = field;
+	return field;
+}
+
+Vector2D ImplicitEngine::randomPoint(const SpawnRegion& region)
+{
+	std::uniform_real_distribution<double> uniform(0., 1.);
+	double u = uniform(_rng);
+	double v = uniform(_rng);
+	return Vector2D(region.min.x() + u*(region.max.x() - region.min.x()), region.min.y() + v*(region.max.y() - region.min.y()));
+}
+
+
+void ImplicitEngine::initializeProblem()
+{
+	TRACE_SCOPE("initializeProblem");
+	configureEnergy();
+	// positions, velocities and goal velocities are read directly from the store
+	_noVars = _activeAgents + _activeAgents;
+	_nn.resize(_activeAgents);
+	if (!_obstacles.empty())
+		_obstacleNn.resize(_activeAgents);
+	// the neighbors change, so the chunks have to be balanced again
+	_chunkAgents = -1;
+
+	// the queries only read the proximity database and the obstacle grid. The threads keep to their own agents in NUMA mode, so that
+	// they allocate the neighbor lists on their nodes
+	_pool.forEach(_activeAgents, [this](int i)
+	{
+		_nn[i].clear();
+		// precompute NN 
+		_store.agent(i)->findNeighbors(_neighborDist, _nn[i]);
+		if (!_obstacles.empty())
+			_obstacles.query(_store.position(i), _neighborDist, _obstacleNn[i]);
+	}, !_numaAware);
+	STATS(for (int i = 0; i < _activeAgents; ++i) _stats.pairs += (int)_nn[i].size() - 1); // the agent finds itself
+	STATS(_stats.pairs /= 2);
+
+	if (_levelOfDetail)
+		separateIsolatedAgents();
+	resetVelocities();
+
+	computeWallClearances();
+}
+
+void ImplicitEngine::computeWallClearances()
 {
-	for (unsigned int i = 0; i < _noAgents; ++i)
+	// the exact clearance of each agent tells the field lookups when the path of the agent has to be checked against the obstacles
+	if (!_distanceField)
+		return;
+	_wallClearance.resize(_activeAgents);
+	_wallPoint.resize(_noVars);
+	_pool.forEach(_activeAgents, [this](int i)
 	{
-		if (_agents[i]->enabled())
+		Vector2D position = _store.position(i);
+		double clearanceSq = _INFTY;
+		for (size_t j = 0; j < _obstacleNn[i].size(); ++j)
 		{
-			_agents[i]->setVelocity(Vector2D(_vNew(_agents[i]->activeID()), _vNew(_agents[i]->activeID() + _activeAgents)));
+			Vector2D closest = _obstacles.segment(_obstacleNn[i][j]).closestPoint(position);
+			double dSq = (closest - position).squaredNorm();
+			if (dSq < clearanceSq)
+			{
+				clearanceSq = dSq;
+				_wallPoint[2 * i] = closest.x();
+				_wallPoint[2 * i + 1] = closest.y();
+			}
 		}
-	}
-	
+		_wallClearance[i] = clearanceSq < _INFTY ? sqrt(clearanceSq) - _store.radius(i) : _INFTY;
+	});
+	_energy.term<ObstacleTerm>().clearance = _wallClearance.data();
+	_energy.term<ObstacleTerm>().wallPoint = _wallPoint.data();
 }
 
-double ImplicitEngine::value(const VectorXd &vNew)
+void ImplicitEngine::solveMultiRate()
 {
-	//const int n = vNew.rows();
-	_posNew = _pos + vNew*_dt;
-	// acceleration and goal velocity contributions
-	double f = 0.5*_dt*((vNew - _vel).array().square()).sum() + 0.5*_ksi*((vNew - _vGoal).array().square()).sum();
+	TRACE_SCOPE("solveMultiRate");
+	const int interacting = _activeAgents;
+	const double dt = _dt;
 
-	bool exit = false;
-	#pragma omp parallel for shared(exit) reduction(+:f) num_threads(_max_threads)
-	for (int i = 0; i < _activeAgents; ++i)
+	// the agents of dense regions take sub-steps together with their neighbors, so that the two classes meet where the crowd is calm
+	_fineAgent.assign(_agents.size(), 0);
+	for (int i = 0; i < interacting; ++i)
 	{
-		if (!exit)
+		if ((int)_nn[i].size() - 1 < _denseNeighbors) // the agent finds itself
+			continue;
+		for (size_t j = 0; j < _nn[i].size(); ++j)
+			_fineAgent[static_cast<ImplicitAgent*>(_nn[i][j])->id()] = 1;
+	}
+
+	// the calm agents take the whole step first, while the others are extrapolated with their current velocities
+	_activeAgents = partitionAgents(interacting, false);
+	_noVars = _activeAgents + _activeAgents;
+	if (_activeAgents > 0)
+	{
+		computeWallClearances();
+		resetVelocities();
+		if (value(_work.vNew) < _INFTY)
 		{
-			size_t id_y = i + _activeAgents;
-			
-			for (unsigned int j = 0; j < _nn[i].size() && !exit; ++j)
+			minimize(_work.vNew);
+			finalizeProblem();
+		}
+		else
+		{
+			// an extrapolated agent would run into a calm one at rest, so all agents take sub-steps this time
+			for (int i = 0; i < _activeAgents; ++i)
+				_fineAgent[_store.agent(i)->id()] = 1;
+		}
+	}
+
+	// the other agents take the sub-steps, during which the calm agents move on linearly with their new velocities
+	int noFine = partitionAgents(interacting, true);
+	STATS(_stats.fineAgents = noFine);
+	const int substeps = noFine > 0 ? _multiRate : 1;
+	_dt = dt / substeps;
+	for (int s = 0; s < substeps; ++s)
+	{
+		if (noFine > 0)
+		{
+			_activeAgents = noFine;
+			_noVars = _activeAgents + _activeAgents;
+			resetVelocities();
+			computeWallClearances();
+			if (value(_work.vNew) >= _INFTY)
 			{
-				const ImplicitAgent* other = static_cast<ImplicitAgent*>(_nn[i][j]);
-				int other_id = other->activeID();
-				//int other_id = this->_mappedIds[other->id()];
-				if (other_id > i)
+				// a calm agent would run into one at rest, so the calm neighbors of the fine agents join them for the rest of the step
+				for (int i = 0; i < noFine; ++i)
 				{
-					size_t other_id_y = other_id + _activeAgents;
-					double radius = _radius[i] + _radius[other_id];
-					// are we colliding?
-					double distance_energy = .0;
-					if (min_distance_energy(_pos[i], _pos[id_y], _pos[other_id], _pos[other_id_y],
-						vNew[i], vNew[id_y], vNew[other_id], vNew[other_id_y], radius, distance_energy))
-						exit = true;
-					else
-					{
-						// compute the ttc energy
-						double ttc_energy = inverse_ttc_energy(_posNew[i], _posNew[id_y], _posNew[other_id], _posNew[other_id_y],
-							vNew[i], vNew[id_y], vNew[other_id], vNew[other_id_y], radius);
-						f += ttc_energy;
-						f += distance_energy;
-
-					}
+					for (size_t j = 0; j < _nn[i].size(); ++j)
+						_fineAgent[static_cast<ImplicitAgent*>(_nn[i][j])->id()] = 1;
 				}
-
+				noFine = partitionAgents(interacting, true);
+				STATS(_stats.fineAgents = noFine);
+				_activeAgents = noFine;
+				_noVars = _activeAgents + _activeAgents;
+				resetVelocities();
+				computeWallClearances();
 			}
-
+			minimize(_work.vNew);
+			finalizeProblem();
 		}
+
+		TRACE_SCOPE("update");
+		const double time = s + 1 < substeps ? _globalTime + (s + 1)*_dt : _globalTime + dt;
+		for (int i = 0; i < _store.size(); ++i)
+			_store.agent(i)->update(_dt, time, _frameDt);
 	}
-	if (exit)
-		f = _INFTY;
+	_dt = dt;
+}
 
-	return f;
+int ImplicitEngine::partitionAgents(int count, bool fine)
+{
+	int front = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if ((_fineAgent[_store.agent(i)->id()] != 0) != fine)
+			continue;
+		if (i != front)
+		{
+			_store.swap(i, front);
+			_nn[i].swap(_nn[front]);
+			if (!_obstacles.empty())
+				_obstacleNn[i].swap(_obstacleNn[front]);
+		}
+		++front;
+	}
+	return front;
 }
 
-double ImplicitEngine::value(const VectorXd &vNew, VectorXd &grad)
+void ImplicitEngine::adaptTimeStep()
 {
-	_posNew = _pos + vNew*_dt;
-	// acceleration and goal velocity contributions
-	VectorXd vNewMinVel = vNew - _vel;
-	VectorXd vNewMinVGoal = vNew - _vGoal;
-	double f = 0.5*_dt*(vNewMinVel.array().square()).sum() + 0.5*_ksi*(vNewMinVGoal.array().square()).sum();
-	grad = _ksi*vNewMinVGoal + (1 / _dt)*vNewMinVel;
+	// the iterations per step barely depend on the time step as long as the solver copes, so keep changing the step in the 
+	// direction that lowers the iterations per simulated second, and turn around once they rise
+	double workRate = _solverIterations / _dt;
+	if (_lastWorkRate > 0 && workRate > _lastWorkRate)
+		_timeStepFactor = 1 / _timeStepFactor;
+	_lastWorkRate = workRate;
+	// the line search running into collisions more often than the solver iterates means that the step is too long
+	if (_solverInfeasible > _solverIterations)
+	{
+		_timeStepFactor = 0.8;
+		_lastWorkRate = 0;
+	}
+	double dt = min(max(_dt*_timeStepFactor, _minTimeStep), _maxTimeStep);
+
+	// the neighbors are searched once per step, so no agent should cross a large part of the neighbor distance in one step.
+	// This bound is a safety limit and wins over the minimum time step
+	double maxSpeedSq = 0;
+	for (int i = 0; i < _store.size(); ++i)
+		maxSpeedSq = max(maxSpeedSq, _store.velocity(i).squaredNorm());
+	maxSpeedSq = globalMax(maxSpeedSq);
+	if (maxSpeedSq > 0)
+		dt = min(dt, 0.25*_neighborDist / sqrt(maxSpeedSq));
+	_dt = dt;
+}
 
-	bool exit = false;
-	//Agents
-	#pragma omp parallel for shared(exit) reduction(+:f) num_threads(_max_threads)
-	for (int i = 0; i < _activeAgents; ++i)
+void ImplicitEngine::separateIsolatedAgents()
+{
+	// an agent that only finds itself has no interaction energy, so its part of the problem is separable and only the
+	// quadratic terms remain. Their gradient, ksi(v - vPref) + (v - vel)/dt, vanishes at the velocity below
+	int interacting = _activeAgents;
+	for (int i = _activeAgents - 1; i >= 0; --i)
 	{
-		if (!exit)
+		if (_nn[i].size() > 1 || (!_obstacles.empty() && !_obstacleNn[i].empty()))
+			continue;
+		--interacting;
+		if (i != interacting)
 		{
-			size_t id_y = i + _activeAgents;
-			for (unsigned int j = 0; j < _nn[i].size() && !exit; ++j)
-			{
-				const ImplicitAgent* other = static_cast<ImplicitAgent*>(_nn[i][j]);
-				int other_id = other->activeID();
-				//int other_id = this->_mappedIds[other->id()];
-				if (other_id != i)
-				{
-					size_t other_id_y = other_id + _activeAgents;
-					double radius = _radius[i] + _radius[other_id];
-					double distance_energy = 0;
-					double g[] = { 0, 0 };
-					if (min_distance_energy(_pos[i], _pos[id_y], _pos[other_id], _pos[other_id_y],
-						vNew[i], vNew[id_y], vNew[other_id], vNew[other_id_y], radius, distance_energy, g))
-						exit = true;
-					else
-					{
-						// compute the ttc energy
-						double ttc_energy = inverse_ttc_energy(_posNew[i], _posNew[id_y], _posNew[other_id], _posNew[other_id_y],
-							vNew[i], vNew[id_y], vNew[other_id], vNew[other_id_y], radius, g);
-
-						if (other_id > i) { // do not add the energy twice!  
-							f += ttc_energy;
-							f += distance_energy;
-						}
-
-						//add the gradients 
-						//In theory we could set the gradient of the neihbor to be the opposite of grad, but assuming openmp is used
-						//it's faster to recompute the energy and does not lead to any shared violations
-						grad[i] += g[0];
-						grad[id_y] += g[1];
-
-					}
-				}
-			}
+			// the interacting agent in the last slot of the problem takes the place of the isolated one
+			_store.swap(i, interacting);
+			_nn[i].swap(_nn[interacting]);
+			if (!_obstacles.empty())
+				_obstacleNn[i].swap(_obstacleNn[interacting]);
 		}
+		_store.setVelocity(interacting, (_store.velocity(interacting) + _dt*_ksi*_store.vPref(interacting)) / (1 + _dt*_ksi));
 	}
+	STATS(_stats.isolatedAgents = _activeAgents - interacting);
+	_activeAgents = interacting;
+	_noVars = _activeAgents + _activeAgents;
+}
 
-	if (exit)
-		f = _INFTY;
+void ImplicitEngine::resetVelocities()
+{
+	//initial optimal velocity is zero to guarantee collision-freeness
+	_work.resize(_noVars, _window, _optimizer == AndersonOptimizer ? _window : 0);
+	// without interacting agents the solve is skipped and the empty views may not point at any memory
+	if (_noVars == 0)
+		return;
+	_work.vNew.setZero();
+}
 
-	return f;
+void ImplicitEngine::finalizeProblem()
+{
+	_store.velocities().head(_noVars) = _work.vNew;
 }
 
+double ImplicitEngine::globalSum(double value) const
+{
+	DISTRIBUTED(if (_domain != NULL) return _domain->sum(value));
+	return value;
+}
 
-bool ImplicitEngine::min_distance_energy(double Pa_x, double Pa_y, double Pb_x, double Pb_y, double Va_x, double Va_y, double Vb_x, double Vb_y, double radius, double& energy, double* grad)
+double ImplicitEngine::globalMax(double value) const
 {
-	energy = 0;
-	double Xx = Pb_x - Pa_x;
-	double Xy = Pb_y - Pa_y;
-	double Vx = Va_x - Vb_x;
-	double Vy = Va_y - Vb_y;
+	DISTRIBUTED(if (_domain != NULL) return _domain->max(value));
+	return value;
+}
 
-	double speed = Vx * Vx + Vy * Vy;
-	double rate = Xx*Vx + Xy*Vy;
-	double tti = rate / (speed + 1e-4); // add a bit of noise since when speed = 0, tti is not differentiable
-	tti = max(min(tti, _dt), 0.);
+double ImplicitEngine::maxNorm(const Eigen::Ref<const VectorXd>& v) const
+{
+	// a process may have no agents in the problem
+	return globalMax(v.size() > 0 ? v.lpNorm<Eigen::Infinity>() : 0);
+}
 
-	double dx = Vx*tti - Xx;
-	double dy = Vy*tti - Xy;
-	double d = dx*dx + dy*dy;
+#ifdef IMPLICIT_MPI
+void ImplicitEngine::distribute(MPI_Comm comm, int balanceInterval)
+{
+	_domain = new DomainDecomposition(comm);
+	_balanceInterval = max(balanceInterval, 1);
+	const int noRanks = _domain->size();
+	_ghosts.resize(noRanks);
+	_sentGhosts.resize(noRanks);
+	_ghostVelocitiesOut.resize(noRanks);
+	_ghostVelocitiesIn.resize(noRanks);
+	if (!_sources.empty())
+	{
+		if (_domain->rank() == 0)
+			std::cerr << "Sources are not supported in distributed runs and are ignored" << std::endl;
+		_sources.clear();
+		_pendingSpawns.clear();
+	}
 
-	if (d <= radius*radius) //tunelling
+	// every process has all agents, so the slabs are balanced over a share of them, and each process drops the agents of the others
+	vector<double> x;
+	for (int i = _domain->rank(); i < _store.size(); i += noRanks)
+		x.push_back(_store.position(i).x());
+	_domain->balance(x);
+	for (int i = _store.size() - 1; i >= 0; --i)
 	{
-		return true;
+		ImplicitAgent* agent = _store.agent(i);
+		if (_domain->owner(agent->position().x()) == _domain->rank())
+			continue;
+		agent->disable();
+		removeActiveAgent(i);
+		_agents[agent->id()] = NULL;
+		delete agent;
+	}
+	// the agents that had already left the simulation are kept by the first process only
+	_agentPool.clear();
+	for (size_t i = 0; i < _agents.size() && _domain->rank() != 0; ++i)
+	{
+		if (_agents[i] != NULL && !_agents[i]->enabled())
+		{
+			delete _agents[i];
+			_agents[i] = NULL;
+		}
 	}
+	_activeAgents = _store.size();
+}
 
-	d = sqrt(d);
-	double distance = d - radius;
-	energy = min(_eta/distance, _INFTY);
+void ImplicitEngine::gatherAgents(int root)
+{
+	TRACE_SCOPE("gatherAgents");
+	vector<string> send(_domain->size()), received;
+	if (_domain->rank() != root)
+	{
+		CheckpointWriter output;
+		for (size_t i = 0; i < _agents.size(); ++i)
+		{
+			if (_agents[i] != NULL)
+				_agents[i]->saveState(output);
+		}
+		send[root] = output.data();
+	}
+	_domain->exchange(send, received);
 
-	if (grad != NULL && rate >0)
+	// the copies are not part of the simulation of the root
+	for (size_t r = 0; r < received.size(); ++r)
 	{
-		double tti_prime_x = 0, tti_prime_y = 0;
-		if (tti > 0 && tti < _dt)
+		CheckpointReader input(received[r]);
+		while (!input.atEnd())
 		{
-			double tti_prime_x = (Xx - 2 * tti*Vx) / speed;
-			double tti_prime_y = (Xy - 2 * tti*Vy) / speed;
+			ImplicitAgent* agent = new ImplicitAgent();
+			agent->loadState(input);
+			if (!input.good() || agent->id() < 0 || agent->id() >= (int)_agents.size() || _agents[agent->id()] != NULL)
+			{
+				delete agent;
+				break;
+			}
+			_agents[agent->id()] = agent;
 		}
-		double scale = -_eta / (d * distance * distance);
-		double distance_prime_x = dx*(tti + Vx*tti_prime_x) + dy*(Vy*tti_prime_x);
-		double distance_prime_y = dy*(tti + Vy*tti_prime_y) + dx*(Vx*tti_prime_y);
-		grad[0] += scale*distance_prime_x;
-		grad[1] += scale*distance_prime_y;
 	}
+}
 
-	return false;
+void ImplicitEngine::exchangeGhosts()
+{
+	TRACE_SCOPE("exchangeGhosts");
+	// the agents of this process within the neighbor distance of another slab are copied there
+	const int noRanks = _domain->size();
+	vector<CheckpointWriter> output(noRanks);
+	vector<int> ranks;
+	for (int r = 0; r < noRanks; ++r)
+		_sentGhosts[r].clear();
+	for (int i = 0; i < _store.size(); ++i)
+	{
+		ImplicitAgent* agent = _store.agent(i);
+		_domain->ranksNear(agent->position().x(), _neighborDist, ranks);
+		for (size_t k = 0; k < ranks.size(); ++k)
+		{
+			CheckpointWriter& ghost = output[ranks[k]];
+			ghost.write(agent->id());
+			ghost.write(agent->gid());
+			ghost.write(agent->position());
+			ghost.write(agent->velocity());
+			ghost.write(agent->goal());
+			ghost.write(agent->radius());
+			ghost.write(agent->prefSpeed());
+			_sentGhosts[ranks[k]].push_back(agent);
+		}
+	}
+	vector<string> send(noRanks), received;
+	for (int r = 0; r < noRanks; ++r)
+		send[r] = output[r].data();
+	_domain->exchange(send, received);
+
+	// the copies follow the agents of this process in the store, and are found by the neighbor searches
+	_ghostBegin = _store.size();
+	AgentInitialParameters par;
+	for (int r = 0; r < noRanks; ++r)
+	{
+		_ghosts[r].clear();
+		CheckpointReader input(received[r]);
+		while (!input.atEnd())
+		{
+			input.read(par.id);
+			input.read(par.gid);
+			input.read(par.position);
+			input.read(par.velocity);
+			input.read(par.goal);
+			input.read(par.radius);
+			input.read(par.prefSpeed);
+			if (!input.good())
+				break;
+			ImplicitAgent* ghost;
+			if (_ghostPool.empty())
+				ghost = new ImplicitAgent();
+			else
+			{
+				ghost = _ghostPool.back();
+				_ghostPool.pop_back();
+			}
+			ghost->init(par, _spatialDatabase, &_store);
+			_ghosts[r].push_back(ghost);
+		}
+		_ghostVelocitiesOut[r].resize(2 * _sentGhosts[r].size());
+		_ghostVelocitiesIn[r].resize(2 * _ghosts[r].size());
+	}
+}
 
+void ImplicitEngine::removeGhosts()
+{
+	// the copies are removed from the back of the store, in the reverse order of their insertion
+	for (int r = _domain->size() - 1; r >= 0; --r)
+	{
+		for (size_t k = _ghosts[r].size(); k-- > 0;)
+		{
+			ImplicitAgent* ghost = _ghosts[r][k];
+			ghost->disable();
+			_store.remove(ghost->activeID());
+			_ghostPool.push_back(ghost);
+		}
+		_ghosts[r].clear();
+	}
+	_ghostBegin = INT_MAX;
 }
 
-// here gradients are explicitly computed, though a bit too verbose (autodiff and/or Eigen will slow things down a bit)
-double ImplicitEngine::inverse_ttc_energy(double Pa_x, double Pa_y, double Pb_x, double Pb_y, double Va_x, double Va_y, double Vb_x, double Vb_y, double radius, double* grad)
+void ImplicitEngine::exchangeGhostVelocities(const Eigen::Ref<const VectorXd>& vNew)
 {
-	
-	double f = 0;
+	TRACE_SCOPE("exchangeGhostVelocities");
+	for (size_t r = 0; r < _sentGhosts.size(); ++r)
+	{
+		for (size_t k = 0; k < _sentGhosts[r].size(); ++k)
+		{
+			// the isolated agents are not part of the problem, and already have their final velocities
+			int id = _sentGhosts[r][k]->activeID();
+			Vector2D velocity = id < _activeAgents ? Vector2D(vNew[2 * id], vNew[2 * id + 1]) : _store.velocity(id);
+			_ghostVelocitiesOut[r][2 * k] = velocity.x();
+			_ghostVelocitiesOut[r][2 * k + 1] = velocity.y();
+		}
+	}
+	_domain->exchange(_ghostVelocitiesOut, _ghostVelocitiesIn);
+	for (size_t r = 0; r < _ghosts.size(); ++r)
+	{
+		for (size_t k = 0; k < _ghosts[r].size(); ++k)
+			_store.setVelocity(_ghosts[r][k]->activeID(), Vector2D(_ghostVelocitiesIn[r][2 * k], _ghostVelocitiesIn[r][2 * k + 1]));
+	}
+}
 
-	//relative velocity
-	double V_x = Va_x - Vb_x;
-	double V_y = Va_y - Vb_y;
+void ImplicitEngine::migrateAgents(bool balance)
+{
+	TRACE_SCOPE("migrateAgents");
+	if (balance)
+	{
+		vector<double> x(_store.size());
+		for (int i = 0; i < _store.size(); ++i)
+			x[i] = _store.position(i).x();
+		_domain->balance(x);
+	}
 
-	//relative displacement
-	double X_x = Pb_x - Pa_x;
-	double X_y = Pb_y - Pa_y;
-	double x = sqrt(X_x*X_x + X_y*X_y);
-	double Xhat_x = X_x;
-	double Xhat_y = X_y;
-	if (x > 0)
+	// iterate backwards so that swapping a leaving agent with the last one never skips an agent
+	const int noRanks = _domain->size();
+	vector<CheckpointWriter> output(noRanks);
+	for (int i = _store.size() - 1; i >= 0; --i)
 	{
-		Xhat_x /= x;
-		Xhat_y /= x;
+		ImplicitAgent* agent = _store.agent(i);
+		int owner = _domain->owner(agent->position().x());
+		if (owner == _domain->rank())
+			continue;
+		agent->disable();
+		removeActiveAgent(i);
+		agent->saveState(output[owner]);
+		_agents[agent->id()] = NULL;
+		delete agent;
 	}
+	vector<string> send(noRanks), received;
+	for (int r = 0; r < noRanks; ++r)
+		send[r] = output[r].data();
+	_domain->exchange(send, received);
 
-	//parallel component
-	double vp = Xhat_x*V_x + Xhat_y*V_y;
-	if (vp < 0) //agents are diverging
+	for (int r = 0; r < noRanks; ++r)
 	{
-		return 0;
+		CheckpointReader input(received[r]);
+		while (!input.atEnd())
+		{
+			ImplicitAgent* agent = new ImplicitAgent();
+			agent->loadState(input);
+			if (!input.good())
+			{
+				delete agent;
+				break;
+			}
+			agent->attach(&_store);
+			agent->insertIntoDatabase(_spatialDatabase);
+			_agents[agent->id()] = agent;
+		}
 	}
+}
+#endif
 
+void ImplicitEngine::configureEnergy()
+{
+	_energy.term<GoalTerm>().ksi = _ksi;
+	TtcTerm& ttc = _energy.term<TtcTerm>();
+	ttc.k = _k;
+	ttc.p = _p;
+	ttc.t0 = _t0;
+	ttc.eps = _eps;
+	_energy.term<DistanceTerm>().eta = _eta;
+	ObstacleTerm& obstacles = _energy.term<ObstacleTerm>();
+	obstacles.eta = _eta;
+	obstacles.ttc = &ttc;
+	obstacles.obstacles = &_obstacles;
+	obstacles.neighbors = &_obstacleNn;
+	obstacles.field = _distanceField.get();
+}
 
-	//tangential component
-	double VT_x = V_x - vp*Xhat_x;
-	double VT_y = V_y - vp*Xhat_y;
-	double vt = sqrt(VT_x*VT_x + VT_y*VT_y);
+template <bool Gradient>
+bool ImplicitEngine::agentEnergy(int i, const EnergyState& state, double& f, double* grad)
+{
+	if (!_energy.agentEnergy<Gradient>(state, i, f, grad))
+		return false;
+	if (!ImplicitEnergy::hasPairEnergy)
+		return true;
 
-	double rSq = radius*radius;
-	double xMinR = x*x - rSq;
-	double xMinR_sqrt = sqrt(xMinR);
-	double nominator = sqrt(1 - _eps*_eps);
-	double vtstar = nominator*radius*vp / xMinR_sqrt;
+	const double* pos = state.position;
+	const double* radii = state.radius;
+	size_t id_x = 2 * i;
+	size_t id_y = id_x + 1;
+	AgentPair pair;
+	pair.Pa_x = pos[id_x];
+	pair.Pa_y = pos[id_y];
+	pair.PaNew_x = state.posNew[id_x];
+	pair.PaNew_y = state.posNew[id_y];
+	pair.Va_x = state.vNew[id_x];
+	pair.Va_y = state.vNew[id_y];
+
+	for (unsigned int j = 0; j < _nn[i].size(); ++j)
+	{
+		const ImplicitAgent* other = static_cast<ImplicitAgent*>(_nn[i][j]);
+		int other_id = other->activeID();
+		if (other_id == i)
+			continue;
+		// do not add the energy twice! A pair with the copy of an agent of another process is evaluated by both processes, and counted by the one owning the agent with the lower id
+		bool counted = other_id > i;
+		DISTRIBUTED(counted = counted && (other_id < _ghostBegin || _store.agent(i)->id() < other->id()));
+		// in theory the gradient of the neighbor is the opposite one, but recomputing it avoids any shared writes between the threads
+		if (!Gradient && !counted)
+			continue;
+
+		size_t other_id_x = 2 * other_id;
+		size_t other_id_y = other_id_x + 1;
+		pair.radius = radii[i] + radii[other_id];
+		// neighbors outside the problem, i.e. of another rate class, move on linearly with their velocities
+		const bool fixed = other_id >= _activeAgents;
+		const double* otherVel = fixed ? _store.velocities().data() : state.vNew;
+		pair.Pb_x = pos[other_id_x];
+		pair.Pb_y = pos[other_id_y];
+		pair.Vb_x = otherVel[other_id_x];
+		pair.Vb_y = otherVel[other_id_y];
+		pair.PbNew_x = fixed ? pair.Pb_x + pair.Vb_x * state.dt : state.posNew[other_id_x];
+		pair.PbNew_y = fixed ? pair.Pb_y + pair.Vb_y * state.dt : state.posNew[other_id_y];
+
+		double pairEnergy = 0;
+		if (!_energy.pairEnergy<Gradient>(state, pair, pairEnergy, grad))
+			return false;
+		if (counted)
+			f += pairEnergy;
+	}
+	return true;
+}
 
-	if (vt < vtstar) // compute inv_ttc as usual
+void ImplicitEngine::arrangeAgents()
+{
+	TRACE_SCOPE("arrangeAgents");
+	// the sort comes before the neighbor queries, which refer to the agents by their new active ids
+	const bool sort = _iteration % _reorderInterval == 0;
+	if (sort)
+		_store.sortAlong(_spatialOrder != InsertionOrder ? _spatialOrder : HilbertOrder, _activeAgents);
+	// contiguous slots are compact regions of the world, so each thread mostly reads the agents it placed
+	if (_numaAware && (sort || _store.capacity() != _placedCapacity))
 	{
-		double discr = sqrt(rSq*vp*vp - xMinR*vt*vt);
-		double inv_ttc = (x*vp + discr) / xMinR;
-		if (inv_ttc > 0)
-		{
-			double mult = _k*pow(inv_ttc, _p - 1)*exp(-(1 / inv_ttc) / _t0);
-			f = mult*inv_ttc;
-			if (grad != NULL)
-			{
-				double VP_x = vp*Xhat_x;
-				double VP_y = vp*Xhat_y;
-				double A_x = -X_x + V_x*_dt - vp*_dt*Xhat_x;
-				double A_y = -X_y + V_y*_dt - vp*_dt*Xhat_y;
-				double B_x = (((_dt*vp + x)*VT_x)*xMinR / x - X_x*_dt*vt*vt + rSq*vp*A_x / x) / discr + _dt*VP_x;
-				double B_y = (((_dt*vp + x)*VT_y)*xMinR / x - X_y*_dt*vt*vt + rSq*vp*A_y / x) / discr + _dt*VP_y;
-				grad[0] += -mult / xMinR*((A_x + B_x)*(_p + 1 / (_t0*inv_ttc)) - 2 * _dt*(1 / _t0 + _p*inv_ttc)*X_x);
-				grad[1] += -mult / xMinR*((A_y + B_y)*(_p + 1 / (_t0*inv_ttc)) - 2 * _dt*(1 / _t0 + _p*inv_ttc)*X_y);
-			}
+		_store.place(_pool, _hugePages);
+		_placedCapacity = _store.capacity();
+	}
+}
 
+void ImplicitEngine::balanceChunks()
+{
+	_chunkStart.assign(1, 0);
+	if (_deterministic)
+	{
+		// fixed blocks of agents, whatever the number of threads
+		for (int i = _blockSize; i < _activeAgents; i += _blockSize)
+			_chunkStart.push_back(i);
+	}
+	else if (_pool.size() > 1)
+	{
+		// the cost of an agent grows with its neighbors and obstacles, so the chunks are cut at equal shares of their total
+		long long total = 0;
+		for (int i = 0; i < _activeAgents; ++i)
+			total += 1 + _nn[i].size() + (_obstacles.empty() ? 0 : _obstacleNn[i].size());
+		const long long noChunks = min(_activeAgents, _chunksPerThread*_pool.size());
+		long long cost = 0;
+		for (int i = 0; i + 1 < _activeAgents; ++i)
+		{
+			cost += 1 + _nn[i].size() + (_obstacles.empty() ? 0 : _obstacleNn[i].size());
+			if (cost*noChunks >= total*(long long)_chunkStart.size())
+				_chunkStart.push_back(i + 1);
 		}
 	}
-	else //linear extrapolation from vtstar
+	_chunkStart.push_back(_activeAgents);
+	_chunkEnergy.resize(_chunkStart.size() - 1);
+	_chunkAgents = _activeAgents;
+}
+
+template <bool Gradient>
+double ImplicitEngine::evaluate(const Eigen::Ref<const VectorXd>& vNew, double* grad)
+{
+	DISTRIBUTED(if (_domain != NULL) exchangeGhostVelocities(vNew));
+	if (_numaAware)
 	{
-		double inv_ttc = (x + _eps*radius)*vp / xMinR - nominator / _eps*(vt - vtstar) / xMinR_sqrt;
-		if (inv_ttc > 0)
+		// the trial positions and the gradient of the agents of each thread are written by that thread first
+		_pool.run(_pool.size(), [&](int t, int)
 		{
-			double mult = _k*exp(-(1 / inv_ttc) / _t0);
-			f = mult*pow(inv_ttc, _p);
-			if (grad != NULL)
-			{
-				double A_x = -X_x / x + V_x*_dt / x - vp*_dt*Xhat_x / x;
-				double A_y = -X_y / x + V_y*_dt / x - vp*_dt*Xhat_y / x;
-				double B_x = ((_eps*radius + x)*A_x) / xMinR + (nominator*((VT_x*_dt*vp / x + VT_x) / vt + radius*nominator / xMinR_sqrt*(A_x - _dt*vp*X_x / (xMinR)))) / (_eps*xMinR_sqrt) - _dt*X_x / xMinR*(vp*(_eps*radius + x) / xMinR - vp / x + inv_ttc);
-				double B_y = ((_eps*radius + x)*A_y) / xMinR + (nominator*((VT_y*_dt*vp / x + VT_y) / vt + radius*nominator / xMinR_sqrt*(A_y - _dt*vp*X_y / (xMinR)))) / (_eps*xMinR_sqrt) - _dt*X_y / xMinR*(vp*(_eps*radius + x) / xMinR - vp / x + inv_ttc);
-				mult *= -pow(inv_ttc, _p - 1)*(_p + 1 / (_t0*inv_ttc));
-				grad[0] += mult*B_x;
-				grad[1] += mult*B_y;
-			}
+			const int begin = 2 * (int)((long long)t*_activeAgents / _pool.size()), end = 2 * (int)((long long)(t + 1)*_activeAgents / _pool.size());
+			_work.posNew.segment(begin, end - begin) = _store.positions().segment(begin, end - begin) + vNew.segment(begin, end - begin)*_dt;
+			if (Gradient)
+				std::fill(grad + begin, grad + end, 0.0);
+		}, false);
+	}
+	else
+	{
+		_work.posNew = _store.positions().head(_noVars) + vNew*_dt;
+		// every agent adds its own entries of the gradient
+		if (Gradient)
+			std::fill(grad, grad + _noVars, 0.0);
+	}
+	EnergyState state = { _dt, _store.positions().data(), _store.velocities().data(), _store.vPrefs().data(), _store.radii().data(), vNew.data(), _work.posNew.data() };
+	double f = 0;
 
+	if (_chunkAgents != _activeAgents)
+		balanceChunks();
+	// set by the first chunk that finds a collision, the others stop as soon as they see it
+	std::atomic<bool> exit(false);
+	_pool.run((int)_chunkEnergy.size(), [&](int c, int)
+	{
+		// one span per chunk, on the thread that took it, to expose how the threads share the neighbor pairs
+		TRACE(TraceScope chunkScope(Gradient ? "value+grad chunk" : "value chunk"));
+		TRACE(long long pairs = 0);
+		double fc = 0;
+		for (int i = _chunkStart[c]; i < _chunkStart[c + 1] && !exit.load(std::memory_order_relaxed); ++i)
+		{
+			TRACE(pairs += _nn[i].size());
+			if (!agentEnergy<Gradient>(i, state, fc, Gradient ? grad + 2 * i : NULL))
+				exit.store(true, std::memory_order_relaxed);
 		}
+		_chunkEnergy[c] = fc;
+		TRACE(chunkScope.setArg("pairs", pairs));
+	});
+	// the partial sums are added in a fixed order
+	for (size_t c = 0; c < _chunkEnergy.size(); ++c)
+		f += _chunkEnergy[c];
+
+	// an infeasible evaluation on any process makes the whole energy infinite
+	DISTRIBUTED(if (_domain != NULL) { f = _domain->sum(exit ? _INFTY : f); if (f >= _INFTY) exit = true; });
+	if (exit)
+	{
+		f = _INFTY;
+		++_solverInfeasible;
+		STATS(++_stats.infeasibleEvaluations);
 	}
 
-	return  f;
+	return f;
 }
 
+double ImplicitEngine::value(const Eigen::Ref<const VectorXd>& vNew)
+{
+	TRACE_SCOPE("value");
+	const double f = evaluate<false>(vNew, NULL);
+	// with a deadline, any point the solver tries can become its result
+	if (_deadline > 0 && f < _bestEnergy)
+	{
+		_bestEnergy = f;
+		_work.best = vNew;
+	}
+	return f;
+}
 
+double ImplicitEngine::value(const Eigen::Ref<const VectorXd>& vNew, Eigen::Ref<VectorXd> grad)
+{
+	TRACE_SCOPE("value+grad");
+	const double f = evaluate<true>(vNew, grad.data());
+	if (_deadline > 0 && f < _bestEnergy)
+	{
+		_bestEnergy = f;
+		_work.best = vNew;
+	}
+	return f;
+}
+
+bool ImplicitEngine::outOfTime()
+{
+	// all processes of a distributed run stop together, or their reductions would not match
+	if (_deadline > 0 && !_timedOut)
+		_timedOut = globalMax(omp_get_wtime() > _deadline ? 1 : 0) > 0;
+	return _timedOut;
+}
+
+bool ImplicitEngine::converged(const Eigen::Ref<const VectorXd>& step)
+{
+	// a line search cut short by the deadline leaves the last full step as the gap
+	if (_timedOut)
+		return true;
+	_stepNorm = maxNorm(step);
+	return _stepNorm < _eps_x;
+}
 
-double ImplicitEngine::linesearch(const Vector<double> & x0, const Vector<double> & searchDir, const double phi0, const Vector<double>& grad, const double alpha_init)
+double ImplicitEngine::linesearch(const Eigen::Ref<const VectorXd>& x0, const Eigen::Ref<const VectorXd>& direction, const double phi0, const Eigen::Ref<const VectorXd>& grad, const double alpha_init)
 {
-	double phi_prime = searchDir.dot(grad);
+	TRACE_SCOPE("linesearch");
+	// the search goes along -direction
+	double phi_prime = -globalSum(direction.dot(grad));
 	// Minimum step length
-	Vector<double> tmp(_noVars);
+	VectorView& tmp = _work.scale;
 	for (size_t i = 0; i < _noVars; ++i)
 	{
 		tmp(i) = max(fabs(x0(i)), 1.);
 	}
 
-	double temp = (searchDir.array().abs() / tmp.array()).maxCoeff();
+	double temp = globalMax(_noVars > 0 ? (direction.array().abs() / tmp.array()).maxCoeff() : 0);
 	double alpha_min = 1e-3 / temp;
 
-	Vector<double> x(_noVars);
+	VectorView& x = _work.trial;
 	double c = 1e-4; // sufficient decrease parameter
 	double alpha = alpha_init; //  try a full Newton step first
 	double alpha_prev = 0;
@@ -452,14 +1495,18 @@ double ImplicitEngine::linesearch(const Vector<double> & x0, const Vector<double
 
 	while (true)
 	{
+		if (outOfTime())
+			return 0;
 		if (alpha < alpha_min)
 			return alpha;// _min;
-		x = x0 + alpha*searchDir;
+		x = x0 - alpha*direction;
 		const double phi = value(x);
+		STATS(++_stats.lineSearchEvaluations);
 		if (phi < phi0 + c*alpha*phi_prime) // Sufficient function decrease
 			break;
 		else //Backtrack
 		{
+			STATS(++_stats.backtracks);
 			if (alpha_prev == 0) // First time, quadratic fit 
 			{
 				alpha_next = -(phi_prime*alpha*alpha) / (2.0*(phi - phi0 - phi_prime*alpha)); //minimize [phi phi0 phi_prime]alpha^2 + phi_prime*alpha + phi0
@@ -498,27 +1545,112 @@ double ImplicitEngine::linesearch(const Vector<double> & x0, const Vector<double
 	return alpha;
 }
 
-void ImplicitEngine::minimize(Vector<double> & x0)
+void ImplicitEngine::minimize(Eigen::Ref<VectorXd> x0)
 {
+	TRACE_SCOPE("minimize");
+#ifdef _DEBUG
+	const long long allocations = eigenAllocations();
+#endif
+
+	_timedOut = false;
+	_stepNorm = std::numeric_limits<double>::infinity();
+	if (_deadline > 0)
+	{
+		// the start is kept if nothing better is found in time
+		_bestEnergy = _INFTY;
+		_work.best = x0;
+	}
 
-	MatrixXd  s = MatrixXd::Zero(_noVars, _window);
-	MatrixXd y = MatrixXd::Zero(_noVars, _window);
+	// the optimizers share the workspace, the line search and the energy of the engine, so they are members selected here rather than
+	// objects behind an interface; the variants of L-BFGS only differ in how an iterate is extrapolated
+	switch (_optimizer)
+	{
+	case ConjugateGradientOptimizer:
+		minimizeConjugateGradient(x0);
+		break;
+	case AcceleratedGradientOptimizer:
+		minimizeAcceleratedGradient(x0);
+		break;
+	default:
+		minimizeLBFGS(x0);
+	}
 
-	Vector<double> alpha = Vector<double>::Zero(_window);
-	Vector<double> rho = Vector<double>::Zero(_window);
-	Vector<double> grad(_noVars), q(_noVars), grad_old(_noVars), x_old(_noVars), s_temp(_noVars), y_temp(_noVars);
+	if (_deadline > 0)
+	{
+		// the iterates of the optimizers need not be the lowest energy they evaluated, but that is finite and thus collision-free
+		x0 = _work.best;
+		_hitDeadline = _hitDeadline || _timedOut;
+	}
+	_convergenceGap = max(_convergenceGap, _stepNorm);
+	STATS(_stats.convergenceGap = _convergenceGap);
+	STATS(_stats.deadlineHit = _hitDeadline ? 1 : 0);
+
+	STATS(_stats.gradientNorm = _work.grad.norm());
+#ifdef _DEBUG
+	// a solve only works in the workspace, whatever the size of the problem, so it creates no Eigen storage
+	assert(eigenAllocations() == allocations);
+#endif
+}
+
+void ImplicitEngine::minimizeLBFGS(Eigen::Ref<VectorXd>& x0)
+{
+	// the vectors live in the workspace, which resetVelocities sized for this problem
+	MatrixView& s = _work.s;
+	MatrixView& y = _work.y;
+	s.setZero();
+	y.setZero();
+
+	VectorXd& alpha = _work.alpha;
+	VectorXd& rho = _work.rho;
+	alpha.setZero();
+	rho.setZero();
+	VectorView& grad = _work.grad, &q = _work.q, &grad_old = _work.gradOld, &x_old = _work.xOld, &s_temp = _work.sTemp, &y_temp = _work.yTemp;
+	VectorView& trial = _work.trial, &momentum = _work.momentum;
+
+	const bool nesterov = _optimizer == NesterovOptimizer, anderson = _optimizer == AndersonOptimizer;
+	// the steps since the momentum was last dropped, and the number and next slot of the Anderson pairs (-1 before the first iterate)
+	int momentumSteps = 0;
+	int mixedPairs = -1, mixedEnd = 0;
+	if (nesterov)
+		momentum.setZero();
 
 	double f = value(x0, grad);
 
 	double gamma_k = 1;
-	double alpha_init = min(1.0, 1.0 / grad.lpNorm<Eigen::Infinity>());
+	double alpha_init = min(1.0, 1.0 / maxNorm(grad));
 	int iter;
 	int end = 0;
 	int j;
 	int maxiter = _newtonIter;
 
-	for (int k = 0; k < maxiter; k++)
+	for (int k = 0; k < maxiter && !outOfTime(); k++)
 	{
+		++_solverIterations;
+		STATS(++_stats.iterations);
+		if (nesterov)
+		{
+			// extrapolate along the last steps, and keep the extrapolated point only if it lowers the energy, which also keeps it feasible
+			const double theta = momentumSteps / (momentumSteps + 3.0);
+			double fTrial = _INFTY;
+			if (theta > 0)
+			{
+				trial = x0 + theta*momentum;
+				fTrial = value(trial, y_temp);
+			}
+			if (fTrial < f)
+			{
+				STATS(++_stats.acceleratedSteps);
+				x0 = trial;
+				grad = y_temp;
+				f = fTrial;
+				momentum *= theta;
+			}
+			else
+			{
+				momentum.setZero();
+				momentumSteps = 0;
+			}
+		}
 		x_old = x0;
 		grad_old = grad;
 		q = grad;
@@ -528,8 +1660,8 @@ void ImplicitEngine::minimize(Vector<double> & x0)
 		j = end;
 		for (int i = 0; i < iter; ++i) {
 			if (--j == -1) j = _window - 1;
-			rho(j) = 1.0 / ((s.col(j)).dot(y.col(j)));
-			alpha(j) = rho(j)*(s.col(j)).dot(q);
+			rho(j) = 1.0 / globalSum((s.col(j)).dot(y.col(j)));
+			alpha(j) = rho(j)*globalSum((s.col(j)).dot(q));
 			q = q - alpha(j)*y.col(j);
 		}
 
@@ -537,38 +1669,218 @@ void ImplicitEngine::minimize(Vector<double> & x0)
 		q = gamma_k*q;
 		for (int i = 0; i < iter; ++i)
 		{
-			double beta = rho(j)*q.dot(y.col(j));
+			double beta = rho(j)*globalSum(q.dot(y.col(j)));
 			q = q + (alpha(j) - beta)*s.col(j);
 			if (++j == _window) j = 0;
 		}
 
 		// is there a valid descent?
-		double dir = q.dot(grad);
+		double dir = globalSum(q.dot(grad));
 		// not a valid direction due to bad Hessian estimation, restart the optimization 
 		if (dir < 1e-4) {
+			STATS(++_stats.restarts);
 			q = grad;
 			maxiter -= k;
 			k = 0;
-			alpha_init = min(1.0, 1.0 / grad.lpNorm<Eigen::Infinity>());
+			alpha_init = min(1.0, 1.0 / maxNorm(grad));
 		}
-		const double rate = linesearch(x0, -q, f, grad, alpha_init);
+		const double rate = linesearch(x0, q, f, grad, alpha_init);
 		x0 = x0 - rate * q; //update solution
 		s_temp = x0 - x_old;
-		if (s_temp.lpNorm<Eigen::Infinity>() < _eps_x) //stop?
+		if (converged(s_temp)) //stop?
 			break;
 
 		f = value(x0, grad);
+		if (nesterov)
+		{
+			momentum += s_temp;
+			++momentumSteps;
+		}
+		else if (anderson)
+		{
+			// the L-BFGS step maps x_old to x0, and the mix of the last iterates of the map that best cancels their steps is tried instead of x0
+			if (mixedPairs >= 0)
+			{
+				_work.dG.col(mixedEnd) = x0 - _work.gLast;
+				_work.dF.col(mixedEnd) = s_temp - _work.fLast;
+				mixedPairs = min(mixedPairs + 1, _window);
+				if (++mixedEnd == _window)
+					mixedEnd = 0;
+			}
+			else
+				mixedPairs = 0;
+			_work.gLast = x0;
+			_work.fLast = s_temp;
+			if (mixedPairs > 0 && andersonMix(mixedPairs))
+			{
+				// like the extrapolation, the mix is only kept if it lowers the energy
+				const double fTrial = value(trial, q);
+				if (fTrial < f)
+				{
+					STATS(++_stats.acceleratedSteps);
+					x0 = trial;
+					grad = q;
+					f = fTrial;
+					s_temp = x0 - x_old;
+				}
+			}
+		}
 		y_temp = grad - grad_old;
 		s.col(end) = s_temp;
 		y.col(end) = y_temp;
 
 		// update the history		
-		gamma_k = s_temp.dot(y_temp) / y_temp.dot(y_temp);
+		gamma_k = globalSum(s_temp.dot(y_temp)) / globalSum(y_temp.dot(y_temp));
 		alpha_init = 1.0;
 		if (++end == _window)
 			end = 0;
 	}
+}
+
+bool ImplicitEngine::andersonMix(int count)
+{
+	// the weights gamma minimize |fLast - dF*gamma| and solve the normal equations of the few columns
+	MatrixXd& normal = _work.normal;
+	VectorXd& gamma = _work.gamma;
+	double diagonal = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		for (int j = 0; j <= i; ++j)
+			normal(i, j) = globalSum(_work.dF.col(i).dot(_work.dF.col(j)));
+		gamma(i) = globalSum(_work.dF.col(i).dot(_work.fLast));
+		diagonal = max(diagonal, normal(i, i));
+	}
+	if (!(diagonal > 0))
+		return false;
+
+	// Cholesky factorization of the lower triangle in place, slightly regularized against nearly dependent steps
+	for (int i = 0; i < count; ++i)
+	{
+		normal(i, i) += 1e-10*diagonal;
+		for (int j = 0; j <= i; ++j)
+		{
+			double sum = normal(i, j);
+			for (int p = 0; p < j; ++p)
+				sum -= normal(i, p)*normal(j, p);
+			if (i > j)
+				normal(i, j) = sum / normal(j, j);
+			else if (sum > 0)
+				normal(i, i) = sqrt(sum);
+			else
+				return false;
+		}
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		for (int p = 0; p < i; ++p)
+			gamma(i) -= normal(i, p)*gamma(p);
+		gamma(i) /= normal(i, i);
+	}
+	for (int i = count - 1; i >= 0; --i)
+	{
+		for (int p = i + 1; p < count; ++p)
+			gamma(i) -= normal(p, i)*gamma(p);
+		gamma(i) /= normal(i, i);
+	}
 
+	_work.trial = _work.gLast;
+	for (int i = 0; i < count; ++i)
+		_work.trial -= gamma(i)*_work.dG.col(i);
+	return true;
 }
 
+void ImplicitEngine::minimizeConjugateGradient(Eigen::Ref<VectorXd>& x0)
+{
+	VectorView& grad = _work.grad, &q = _work.q, &grad_old = _work.gradOld, &x_old = _work.xOld, &s_temp = _work.sTemp, &y_temp = _work.yTemp;
+
+	double f = value(x0, grad);
+	// the search goes along -q, starting with the steepest descent
+	q = grad;
+	double dir = globalSum(q.dot(grad));
+	double alpha_init = min(1.0, 1.0 / maxNorm(grad));
 
+	for (int k = 0; k < _newtonIter && !outOfTime(); k++)
+	{
+		++_solverIterations;
+		STATS(++_stats.iterations);
+		x_old = x0;
+		grad_old = grad;
+
+		const double rate = linesearch(x0, q, f, grad, alpha_init);
+		x0 = x0 - rate * q;
+		s_temp = x0 - x_old;
+		if (converged(s_temp))
+			break;
+
+		f = value(x0, grad);
+		// Polak-Ribiere+, which falls back to the steepest descent by itself when the gradient turns
+		y_temp = grad - grad_old;
+		const double gradSq = globalSum(grad_old.dot(grad_old));
+		const double beta = gradSq > 0 ? max(0.0, globalSum(grad.dot(y_temp)) / gradSq) : 0.0;
+		q = grad + beta*q;
+		double dirNew = globalSum(q.dot(grad));
+		// the line search only goes downhill, so a direction that is not a descent one is replaced by the steepest descent
+		if (dirNew <= 0)
+		{
+			STATS(++_stats.restarts);
+			q = grad;
+			dirNew = globalSum(q.dot(grad));
+		}
+		// the first trial expects the same decrease as the last step, but moves the agents at least as far as a restart would, so that
+		// the search does not stall after a short step
+		alpha_init = min(1.0, max(rate*dir / dirNew, 1.0 / maxNorm(q)));
+		dir = dirNew;
+	}
+}
+
+void ImplicitEngine::minimizeAcceleratedGradient(Eigen::Ref<VectorXd>& x0)
+{
+	VectorView& grad = _work.grad, &momentum = _work.momentum, &y = _work.yTemp;
+
+	// the steps since the momentum was last restarted
+	int momentumSteps = 0;
+	momentum.setZero();
+	double alpha_init = 0;
+
+	for (int k = 0; k < _newtonIter && !outOfTime(); k++)
+	{
+		++_solverIterations;
+		STATS(++_stats.iterations);
+		// the gradient step starts from the point extrapolated along the last steps, or from x0 if that point is infeasible
+		const double theta = momentumSteps / (momentumSteps + 3.0);
+		y = x0 + theta*momentum;
+		double f = value(y, grad);
+		if (theta > 0)
+		{
+			if (f < _INFTY)
+				STATS(++_stats.acceleratedSteps);
+			else
+			{
+				STATS(++_stats.restarts);
+				momentumSteps = 0;
+				y = x0;
+				f = value(y, grad);
+			}
+		}
+		if (k == 0)
+			alpha_init = min(1.0, 1.0 / maxNorm(grad));
+
+		const double rate = linesearch(y, grad, f, grad, alpha_init);
+		y -= rate*grad;
+		momentum = y - x0;
+		x0 = y;
+		if (converged(momentum))
+			break;
+
+		// the momentum is restarted when it points uphill
+		if (globalSum(grad.dot(momentum)) > 0)
+		{
+			STATS(++_stats.restarts);
+			momentumSteps = 0;
+		}
+		else
+			++momentumSteps;
+		// the step may grow again after backtracking, but starts no shorter than the first one
+		alpha_init = min(1.0, max(2.0 * rate, 1.0 / maxNorm(grad)));
+	}
+}
@@ -26,7 +26,9 @@
 
 #include "callisto/VisualizerCallisto.h"
 #include "util/Draw.h"
-#include "ImplicitEngine.h"
+#include "implicitEngine.h"
+#include "Scenario.h"
+#include "Trace.h"
 #include "conio.h"
 using namespace Callisto;
 
@@ -38,6 +40,8 @@ double dt = 0.2;
 double xMin, xMax, yMin, yMax;
 // the engine
 ImplicitEngine * _engine = 0;
+// the rank of this process in a distributed run; only the first process shows the simulation
+int processRank = 0;
 
 
 string getCmdOption(char ** begin, char ** end, const string & option)
@@ -58,61 +62,35 @@ void destroy()
 }
 
 
-void setupScenario(const string &name)
+void setupScenario(const string &name, const string &checkpointName)
 {
-
-	std::ifstream input(name);
-	if (input.fail())
+	Scenario scenario;
+	if (!scenario.load(name))
 	{
-		std::cerr << "Cannot read scenario file" << std::endl;
 		destroy();
 		exit(1);
 	}
 
-	try {
-		
-		input >> xMin;
-		input >> xMax;
-		input >> yMin;
-		input >> yMax;
-		
-		//initialize the engine, given the dimensions of the environment
-		_engine->init(xMax - xMin,yMax - yMin, 10, 10);
-	
-		// Read the default parameters for the agents	
-		int nrAgents;
-		input >> nrAgents;
-		AgentInitialParameters par;
-		par.velocity = Vector2D(0, 0); // assume agents start at rest
-		par.goalRadius = 1.; // assume a fixed goal radius for all agents 
-		par.maxSpeed = 2.; // assume a fixed maxspeed (actually is not being currently used)
-
-		for (int i = 0; i < nrAgents; ++i)
-		{
-			input >> par.gid;
-			input >> par.position.x();
-			input >> par.position.y();
-			input >> par.goal.x();
-			input >> par.goal.y();
-			input >> par.prefSpeed;
-			input >> par.radius;
-			_engine->addAgent(par);
-		}		
-	}
-	catch (std::exception &e) {
-		std::cerr << "Error reading the scenario file \n" << e.what() << "\n";
+	xMin = scenario.xMin();
+	xMax = scenario.xMax();
+	yMin = scenario.yMin();
+	yMax = scenario.yMax();
+
+	//initialize the engine, given the dimensions of the environment, and add the agents
+	if (checkpointName.empty())
+		scenario.populate(*_engine);
+	// or continue a previous run; the checkpoint holds the agents and the parameters
+	else if (!_engine->loadCheckpoint(checkpointName))
+	{
 		destroy();
 		exit(1);
 	}
-
-	input.close();	
-
 }
 
 void draw()
 {
 	VisualizerCallisto::resetAnimation();
-	double animation_step = dt;
+	double animation_step = _engine->getFrameStep();
 	const vector<ImplicitAgent*>& agents = _engine->getAgents();
 	for (unsigned int j = 0; j < agents.size(); ++j)
 	{
@@ -123,7 +101,7 @@ void draw()
 		//set the color based on the color id of the group	
 		VisualizerCallisto::setCharacterColor(charId, groupColors[agent->gid() % 7].r, groupColors[agent->gid() % 7].g, groupColors[agent->gid() % 7].b);
 		//Animate the character	
-		double time = 0.;
+		double time = agent->spawnTime();
 		vector<Vector2D> path = agent->path();
 		vector<Vector2D> or = agent->orientations();
 		vector<Vector2D>::iterator it2 = or.begin();
@@ -158,16 +136,50 @@ void draw()
 		}
 		VisualizerCallisto::createLines(pid, 1, np, points, 0, 0, 1);
 	}
+
+	// draw the obstacles
+	const vector<LineObstacle>& obstacles = _engine->getObstacles().segments();
+	if (!obstacles.empty())
+	{
+		int gobstacles = VisualizerCallisto::createGroup("obstacles", VisualizerCallisto::getDrawingID());
+		int nrLines = (int)obstacles.size();
+		int *np = new int[nrLines];
+		float *points = new float[nrLines * 6];
+		float *ptr = points;
+		for (int i = 0; i < nrLines; ++i)
+		{
+			np[i] = 2;
+			*ptr++ = (float)obstacles[i].a.x();
+			*ptr++ = (float)obstacles[i].a.y();
+			*ptr++ = 0;
+			*ptr++ = (float)obstacles[i].b.x();
+			*ptr++ = (float)obstacles[i].b.y();
+			*ptr++ = 0;
+		}
+		VisualizerCallisto::createLines(gobstacles, nrLines, np, points, 0, 0, 0);
+		delete[] np;
+		delete[] points;
+	}
 }
 
 
 int main(int argc, char **argv)
 {	
+#ifdef IMPLICIT_MPI
+	MPI_Init(&argc, &argv);
+	MPI_Comm_rank(MPI_COMM_WORLD, &processRank);
+#endif
 	//parse command line arguments
 	string dtArgs = getCmdOption(argv, argv + argc, "-dt");
 	string framesArgs = getCmdOption(argv, argv + argc, "-frames");
 	string scenarioFilename = getCmdOption(argv, argv + argc, "-scenario");
 	string parFilename = getCmdOption(argv, argv + argc, "-parameters");
+	string statsFilename = getCmdOption(argv, argv + argc, "-stats");
+	string traceFilename = getCmdOption(argv, argv + argc, "-trace");
+	string checkpointFilename = getCmdOption(argv, argv + argc, "-checkpoint");
+	string checkpointEveryArgs = getCmdOption(argv, argv + argc, "-checkpointEvery");
+	string restoreFilename = getCmdOption(argv, argv + argc, "-restore");
+	int checkpointEvery = checkpointEveryArgs.empty() ? 0 : atoi(checkpointEveryArgs.c_str());
 
 	if (!dtArgs.empty())
 		dt = atof(dtArgs.c_str());
@@ -178,29 +190,100 @@ int main(int argc, char **argv)
 	_engine = new ImplicitEngine();
 	_engine->setTimeStep(dt);
 	_engine->setMaxSteps(numFrames);
-	setupScenario(scenarioFilename);
+	setupScenario(scenarioFilename, restoreFilename);
 	
 	//read some parameters
-	Parser cParser;
-	if (!parFilename.empty())
-		cParser.registerParameters(parFilename);
-	_engine->readParameters(cParser);
+	if (restoreFilename.empty())
+	{
+		Parser cParser;
+		if (!parFilename.empty())
+			cParser.registerParameters(parFilename);
+		_engine->readParameters(cParser);
+	}
+	else
+	{
+		// a restored run keeps its time step, and may be extended to more frames
+		dt = _engine->getFrameStep();
+		if (!framesArgs.empty())
+			_engine->setMaxSteps(numFrames);
+	}
+
+#ifdef IMPLICIT_MPI
+	// every process has set up the whole scenario, and keeps its slab of the world
+	_engine->distribute();
+	if (!checkpointFilename.empty())
+	{
+		if (processRank == 0)
+			std::cerr << "Checkpoints of distributed runs are not supported" << std::endl;
+		checkpointFilename.clear();
+	}
+	// the first process reports for all
+	if (processRank != 0)
+	{
+		statsFilename.clear();
+		traceFilename.clear();
+	}
+#endif
 
 	//set the visualizer
-	VisualizerCallisto::init();
-	VisualizerCallisto::displayEnvironment(scenarioFilename.substr(scenarioFilename.find_last_of('/') + 1));
-	VisualizerCallisto::setBackgroundColour(0, 0.99f, 0.99f, 0.99f);
-	VisualizerCallisto::setBoundingBox((float)xMin, (float)xMax, (float)yMin, (float)yMax);
-	VisualizerCallisto::resetDrawing();
-	VisualizerCallisto::resetAnimation();		
+	if (processRank == 0)
+	{
+		VisualizerCallisto::init();
+		VisualizerCallisto::displayEnvironment(scenarioFilename.substr(scenarioFilename.find_last_of('/') + 1));
+		VisualizerCallisto::setBackgroundColour(0, 0.99f, 0.99f, 0.99f);
+		VisualizerCallisto::setBoundingBox((float)xMin, (float)xMax, (float)yMin, (float)yMax);
+		VisualizerCallisto::resetDrawing();
+		VisualizerCallisto::resetAnimation();
+	}
+
+	// record a timeline of the engine
+	if (!traceFilename.empty())
+	{
+#ifdef IMPLICIT_TRACE
+		Trace::start(traceFilename);
+#else
+		std::cerr << "Tracing is not available, compile with IMPLICIT_TRACE" << std::endl;
+#endif
+	}
 
 	// Run the scenario
-	std::cout << "Computing simulation" << std::endl;
+	if (processRank == 0)
+		std::cout << "Computing simulation" << std::endl;
 	do
 	{
 		_engine->updateSimulation();
+		if (checkpointEvery > 0 && !checkpointFilename.empty() && _engine->getIterationNumber() % checkpointEvery == 0)
+			_engine->saveCheckpoint(checkpointFilename);
 	} while (!_engine->endSimulation());
-	std::cout << "Simulation has ended" << std::endl;
+	if (processRank == 0)
+		std::cout << "Simulation has ended" << std::endl;
+	if (!checkpointFilename.empty())
+	{
+		_engine->saveCheckpoint(checkpointFilename);
+		_engine->waitForCheckpoint();
+	}
+	TRACE(if (Trace::enabled()) Trace::stop());
+
+	// dump the solver statistics
+	if (!statsFilename.empty())
+	{
+#ifdef IMPLICIT_STATS
+		writeStats(_engine->getStatsHistory(), statsFilename);
+#else
+		std::cerr << "Solver statistics are not available, compile with IMPLICIT_STATS" << std::endl;
+#endif
+	}
+
+#ifdef IMPLICIT_MPI
+	// the first process draws the agents of all processes
+	_engine->gatherAgents(0);
+	if (processRank != 0)
+	{
+		destroy();
+		MPI_Finalize();
+		return 0;
+	}
+#endif
 
 	// animate agents
 	draw();
@@ -213,6 +296,9 @@ int main(int argc, char **argv)
 	//finalize the environment
 	destroy();
 	VisualizerCallisto::destroy();
+#ifdef IMPLICIT_MPI
+	MPI_Finalize();
+#endif
 
 	return 0;
 	
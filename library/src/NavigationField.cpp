@@ -0,0 +1,303 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "NavigationField.h"
+#include "Checkpoint.h"
+#include <map>
+#include <mutex>
+#include <queue>
+#include <functional>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	const unsigned int navigationFieldMagic = 0x46564e49; // "INVF"
+	const unsigned int navigationFieldVersion = 1;
+
+	/// A field in use in this process, computed once by its first user while the others wait for it
+	struct CacheSlot
+	{
+		std::once_flag once;
+		unique_ptr<const NavigationField> field;
+	};
+	/// The slots in use, guarded by the mutex only while they are looked up
+	std::mutex cacheMutex;
+	std::map<unsigned long long, weak_ptr<CacheSlot>> cache;
+
+	/// Returns the distance from p to the region, zero inside it
+	double distanceToRegion(const Vector2D& p, const SpawnRegion& region)
+	{
+		double dx = max(max(region.min.x() - p.x(), p.x() - region.max.x()), 0.);
+		double dy = max(max(region.min.y() - p.y(), p.y() - region.max.y()), 0.);
+		return sqrt(dx*dx + dy*dy);
+	}
+}
+
+
+NavigationField::NavigationField()
+{
+	_origin = Vector2D(0, 0);
+	_cellSize = 1;
+	_xNodes = _yNodes = 0;
+	_hash = 0;
+}
+
+shared_ptr<const NavigationField> NavigationField::obtain(const ObstacleGrid& obstacles, const SpawnRegion& goal, const SpawnRegion& extent,
+	double cellSize, double clearance, const string& cacheDirectory, TaskPool& pool)
+{
+	unsigned long long key = hash(obstacles, goal, extent, cellSize, clearance);
+	shared_ptr<CacheSlot> slot;
+	{
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		weak_ptr<CacheSlot>& entry = cache[key];
+		slot = entry.lock();
+		if (!slot)
+		{
+			slot.reset(new CacheSlot());
+			entry = slot;
+		}
+	}
+
+	std::call_once(slot->once, [&]()
+	{
+		NavigationField* field = new NavigationField();
+		slot->field.reset(field);
+		string fileName;
+		if (!cacheDirectory.empty())
+		{
+			std::ostringstream name;
+			name << cacheDirectory << "/navigation_" << std::hex << key << ".bin";
+			fileName = name.str();
+		}
+		if (fileName.empty() || !field->load(fileName) || field->_hash != key)
+		{
+			field->compute(obstacles, goal, extent, cellSize, clearance, pool);
+			field->_hash = key;
+			if (!fileName.empty() && !field->save(fileName))
+				std::cerr << "Cannot write the navigation field cache " << fileName << std::endl;
+		}
+	});
+	// the users share the slot, so that it expires with the last of them
+	return shared_ptr<const NavigationField>(slot, slot->field.get());
+}
+
+unsigned long long NavigationField::hash(const ObstacleGrid& obstacles, const SpawnRegion& goal, const SpawnRegion& extent, double cellSize, double clearance)
+{
+	unsigned long long h = hashSeed;
+	hashValue(h, navigationFieldVersion);
+	hashValue(h, cellSize);
+	hashValue(h, clearance);
+	double bounds[] = { goal.min.x(), goal.min.y(), goal.max.x(), goal.max.y(), extent.min.x(), extent.min.y(), extent.max.x(), extent.max.y() };
+	hashValue(h, bounds);
+	const vector<LineObstacle>& segments = obstacles.segments();
+	for (size_t i = 0; i < segments.size(); ++i)
+	{
+		hashValue(h, segments[i].a.x());
+		hashValue(h, segments[i].a.y());
+		hashValue(h, segments[i].b.x());
+		hashValue(h, segments[i].b.y());
+	}
+	return h;
+}
+
+void NavigationField::compute(const ObstacleGrid& obstacles, const SpawnRegion& goal, const SpawnRegion& extent, double cellSize, double clearance, TaskPool& pool)
+{
+	// keep the number of samples bounded for large maps
+	Vector2D size = extent.max - extent.min;
+	const double maxNodes = 1 << 24;
+	_cellSize = cellSize > 0 ? cellSize : 0.25;
+	while ((size.x() / _cellSize + 2)*(size.y() / _cellSize + 2) > maxNodes)
+		_cellSize *= 2;
+	// a wall between two neighboring samples has to block one of them, otherwise the march would leak through it
+	clearance = max(clearance, 0.5*_cellSize);
+	_origin = extent.min;
+	_xNodes = (int)ceil(size.x() / _cellSize) + 1;
+	_yNodes = (int)ceil(size.y() / _cellSize) + 1;
+	const int noNodes = _xNodes*_yNodes;
+
+	vector<char> blocked(noNodes);
+	const int noChunks = min(noNodes, 4 * pool.size());
+	pool.run(noChunks, [&](int chunk, int)
+	{
+		vector<int> nearby;
+		const int end = (int)((long long)(chunk + 1)*noNodes / noChunks);
+		for (int n = (int)((long long)chunk*noNodes / noChunks); n < end; ++n)
+		{
+			Vector2D node = _origin + Vector2D((n % _xNodes)*_cellSize, (n / _xNodes)*_cellSize);
+			obstacles.query(node, clearance, nearby);
+			blocked[n] = !nearby.empty();
+		}
+	});
+
+	// fast marching from the samples around the goal region, which start at their distance from it
+	const double inf = std::numeric_limits<double>::infinity();
+	vector<double> T(noNodes, inf);
+	vector<char> accepted(noNodes, 0);
+	typedef std::pair<double, int> Trial;
+	std::priority_queue<Trial, vector<Trial>, std::greater<Trial> > trial;
+	for (int n = 0; n < noNodes; ++n)
+	{
+		Vector2D node = _origin + Vector2D((n % _xNodes)*_cellSize, (n / _xNodes)*_cellSize);
+		double d = distanceToRegion(node, goal);
+		if (!blocked[n] && d <= 1.5*_cellSize)
+		{
+			T[n] = d;
+			trial.push(Trial(d, n));
+		}
+	}
+
+	const int dx[] = { -1, 1, 0, 0 };
+	const int dy[] = { 0, 0, -1, 1 };
+	while (!trial.empty())
+	{
+		Trial top = trial.top();
+		trial.pop();
+		int n = top.second;
+		if (accepted[n] || top.first > T[n])
+			continue;
+		accepted[n] = 1;
+
+		int x = n % _xNodes;
+		int y = n / _xNodes;
+		for (int k = 0; k < 4; ++k)
+		{
+			int nx = x + dx[k];
+			int ny = y + dy[k];
+			if (nx < 0 || nx >= _xNodes || ny < 0 || ny >= _yNodes)
+				continue;
+			int m = ny*_xNodes + nx;
+			if (accepted[m] || blocked[m])
+				continue;
+
+			// upwind update from the accepted neighbors along each axis
+			double a = min(nx > 0 && accepted[m - 1] ? T[m - 1] : inf, nx + 1 < _xNodes && accepted[m + 1] ? T[m + 1] : inf);
+			double b = min(ny > 0 && accepted[m - _xNodes] ? T[m - _xNodes] : inf, ny + 1 < _yNodes && accepted[m + _xNodes] ? T[m + _xNodes] : inf);
+			double t;
+			if (fabs(a - b) < _cellSize)
+				t = 0.5*(a + b + sqrt(2 * _cellSize*_cellSize - (a - b)*(a - b)));
+			else
+				t = min(a, b) + _cellSize;
+			if (t < T[m])
+			{
+				T[m] = t;
+				trial.push(Trial(t, m));
+			}
+		}
+	}
+
+	// the direction is the negative gradient of the travel distance, from the reachable neighbors
+	_distance.resize(noNodes);
+	_direction.assign(2 * noNodes, 0.f);
+	for (int n = 0; n < noNodes; ++n)
+	{
+		_distance[n] = T[n] < inf ? (float)T[n] : -1.f;
+		if (T[n] == inf || T[n] == 0)
+			continue;
+		int x = n % _xNodes;
+		int y = n / _xNodes;
+		double left = x > 0 ? T[n - 1] : inf, right = x + 1 < _xNodes ? T[n + 1] : inf;
+		double down = y > 0 ? T[n - _xNodes] : inf, up = y + 1 < _yNodes ? T[n + _xNodes] : inf;
+		double gx = 0, gy = 0;
+		if (left < inf && right < inf) gx = 0.5*(right - left);
+		else if (right < inf) gx = right - T[n];
+		else if (left < inf) gx = T[n] - left;
+		if (down < inf && up < inf) gy = 0.5*(up - down);
+		else if (up < inf) gy = up - T[n];
+		else if (down < inf) gy = T[n] - down;
+		double norm = sqrt(gx*gx + gy*gy);
+		if (norm > 0)
+		{
+			_direction[2 * n] = (float)(-gx / norm);
+			_direction[2 * n + 1] = (float)(-gy / norm);
+		}
+	}
+}
+
+Vector2D NavigationField::direction(const Vector2D& p) const
+{
+	double fx = (p.x() - _origin.x()) / _cellSize;
+	double fy = (p.y() - _origin.y()) / _cellSize;
+	if (!(fx >= 0 && fy >= 0 && fx < _xNodes - 1 && fy < _yNodes - 1))
+		return Vector2D(0, 0);
+
+	int x = (int)fx;
+	int y = (int)fy;
+	double tx = fx - x;
+	double ty = fy - y;
+	const float* d = &_direction[2 * (y*_xNodes + x)];
+	const int row = 2 * _xNodes;
+	Vector2D v((1 - ty)*((1 - tx)*d[0] + tx*d[2]) + ty*((1 - tx)*d[row] + tx*d[row + 2]),
+		(1 - ty)*((1 - tx)*d[1] + tx*d[3]) + ty*((1 - tx)*d[row + 1] + tx*d[row + 3]));
+	double norm = v.norm();
+	return norm > 1e-6 ? Vector2D(v / norm) : Vector2D(0, 0);
+}
+
+double NavigationField::travelDistance(const Vector2D& p) const
+{
+	int x = (int)floor((p.x() - _origin.x()) / _cellSize + 0.5);
+	int y = (int)floor((p.y() - _origin.y()) / _cellSize + 0.5);
+	if (x < 0 || y < 0 || x >= _xNodes || y >= _yNodes)
+		return -1;
+	return _distance[y*_xNodes + x];
+}
+
+bool NavigationField::load(const string& fileName)
+{
+	CheckpointReader input;
+	if (!input.readFromFile(fileName))
+		return false;
+	unsigned int magic = 0, version = 0;
+	input.read(magic);
+	input.read(version);
+	if (magic != navigationFieldMagic || version != navigationFieldVersion)
+		return false;
+	input.read(_hash);
+	input.read(_origin);
+	input.read(_cellSize);
+	input.read(_xNodes);
+	input.read(_yNodes);
+	if (!input.good() || _xNodes < 0 || _yNodes < 0 || (double)_xNodes*_yNodes > (1 << 26))
+		return false;
+	_distance.resize(_xNodes*_yNodes);
+	_direction.resize(2 * _distance.size());
+	input.readArray(_distance.data(), _distance.size());
+	input.readArray(_direction.data(), _direction.size());
+	return input.good() && input.atEnd();
+}
+
+bool NavigationField::save(const string& fileName) const
+{
+	CheckpointWriter output;
+	output.write(navigationFieldMagic);
+	output.write(navigationFieldVersion);
+	output.write(_hash);
+	output.write(_origin);
+	output.write(_cellSize);
+	output.write(_xNodes);
+	output.write(_yNodes);
+	output.writeArray(_distance.data(), _distance.size());
+	output.writeArray(_direction.data(), _direction.size());
+	return output.writeToFile(fileName);
+}
@@ -0,0 +1,152 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "Obstacles.h"
+#include <algorithm>
+using namespace std;
+
+
+ObstacleGrid::ObstacleGrid()
+{
+	_built = true;
+	_origin = Vector2D(0, 0);
+	_cellSize = 1;
+	_xCells = _yCells = 0;
+}
+
+void ObstacleGrid::addSegment(const Vector2D& a, const Vector2D& b)
+{
+	if (a == b)
+		return;
+	LineObstacle segment;
+	segment.a = a;
+	segment.b = b;
+	_segments.push_back(segment);
+	_built = false;
+}
+
+void ObstacleGrid::addPolygon(const vector<Vector2D>& vertices)
+{
+	for (size_t i = 0; i < vertices.size(); ++i)
+		addSegment(vertices[i], vertices[(i + 1) % vertices.size()]);
+}
+
+void ObstacleGrid::build(double cellSize)
+{
+	_cellStart.clear();
+	_cellItems.clear();
+	_built = true;
+	_xCells = _yCells = 0;
+	if (_segments.empty())
+		return;
+
+	Vector2D minCorner = _segments[0].a;
+	Vector2D maxCorner = _segments[0].a;
+	for (size_t i = 0; i < _segments.size(); ++i)
+	{
+		minCorner = minCorner.cwiseMin(_segments[i].a).cwiseMin(_segments[i].b);
+		maxCorner = maxCorner.cwiseMax(_segments[i].a).cwiseMax(_segments[i].b);
+	}
+	Vector2D extent = maxCorner - minCorner;
+
+	// keep the number of cells bounded for large maps
+	const double maxCells = 1 << 22;
+	_cellSize = cellSize > 0 ? cellSize : 1;
+	while ((extent.x() / _cellSize + 1)*(extent.y() / _cellSize + 1) > maxCells)
+		_cellSize *= 2;
+	_origin = minCorner;
+	_xCells = (int)(extent.x() / _cellSize) + 1;
+	_yCells = (int)(extent.y() / _cellSize) + 1;
+
+	// count the segments per cell, then fill the cells
+	vector<int> cells;
+	_cellStart.assign(_xCells*_yCells + 1, 0);
+	for (size_t i = 0; i < _segments.size(); ++i)
+	{
+		cellsOf(_segments[i], cells);
+		for (size_t c = 0; c < cells.size(); ++c)
+			++_cellStart[cells[c] + 1];
+	}
+	for (size_t c = 1; c < _cellStart.size(); ++c)
+		_cellStart[c] += _cellStart[c - 1];
+	_cellItems.resize(_cellStart.back());
+	vector<int> fill(_cellStart.begin(), _cellStart.end() - 1);
+	for (size_t i = 0; i < _segments.size(); ++i)
+	{
+		cellsOf(_segments[i], cells);
+		for (size_t c = 0; c < cells.size(); ++c)
+			_cellItems[fill[cells[c]]++] = (int)i;
+	}
+}
+
+void ObstacleGrid::cellsOf(const LineObstacle& segment, vector<int>& cells) const
+{
+	cells.clear();
+	int x0 = (int)((min(segment.a.x(), segment.b.x()) - _origin.x()) / _cellSize);
+	int x1 = (int)((max(segment.a.x(), segment.b.x()) - _origin.x()) / _cellSize);
+	int y0 = (int)((min(segment.a.y(), segment.b.y()) - _origin.y()) / _cellSize);
+	int y1 = (int)((max(segment.a.y(), segment.b.y()) - _origin.y()) / _cellSize);
+	x1 = min(x1, _xCells - 1);
+	y1 = min(y1, _yCells - 1);
+
+	// a cell is crossed only if the segment passes within half a diagonal from its center
+	const double halfDiagonalSq = 0.5*_cellSize*_cellSize;
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			Vector2D center = _origin + Vector2D((x + 0.5)*_cellSize, (y + 0.5)*_cellSize);
+			if ((segment.closestPoint(center) - center).squaredNorm() <= halfDiagonalSq)
+				cells.push_back(y*_xCells + x);
+		}
+	}
+}
+
+void ObstacleGrid::query(const Vector2D& center, double radius, vector<int>& results) const
+{
+	results.clear();
+	if (_xCells == 0)
+		return;
+
+	int x0 = max(0, (int)floor((center.x() - radius - _origin.x()) / _cellSize));
+	int x1 = min(_xCells - 1, (int)floor((center.x() + radius - _origin.x()) / _cellSize));
+	int y0 = max(0, (int)floor((center.y() - radius - _origin.y()) / _cellSize));
+	int y1 = min(_yCells - 1, (int)floor((center.y() + radius - _origin.y()) / _cellSize));
+
+	const double radiusSq = radius*radius;
+	for (int y = y0; y <= y1; ++y)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			const int c = y*_xCells + x;
+			for (int k = _cellStart[c]; k < _cellStart[c + 1]; ++k)
+			{
+				const LineObstacle& segment = _segments[_cellItems[k]];
+				if ((segment.closestPoint(center) - center).squaredNorm() <= radiusSq)
+					results.push_back(_cellItems[k]);
+			}
+		}
+	}
+
+	// long segments are stored in several cells
+	std::sort(results.begin(), results.end());
+	results.erase(std::unique(results.begin(), results.end()), results.end());
+}
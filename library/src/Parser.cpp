@@ -21,6 +21,7 @@
 
 
 #include "Parser.h"
+#include <sstream>
 
 Parser::Parser()
 {
@@ -98,6 +99,29 @@ void Parser::trimspaces(std::string& value)
 }
 
 
+void Parser::setValue(const string& key, const string& value)
+{
+	int idx = findKey(key);
+	if (idx >= 0)
+	{
+		args[idx].value = value;
+		return;
+	}
+	Parameter par;
+	par.key = key;
+	par.value = value;
+	args.push_back(par);
+}
+
+void Parser::setValue(const string& key, double value)
+{
+	std::ostringstream str;
+	str.precision(17);
+	str << value;
+	setValue(key, str.str());
+}
+
+
 bool Parser::registerParameters(const string& fileName)
 {
 	string line;
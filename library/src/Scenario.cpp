@@ -0,0 +1,146 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "Scenario.h"
+#include "implicitEngine.h"
+#include <fstream>
+#include <iostream>
+
+
+Scenario::Scenario()
+{
+	_xMin = _xMax = _yMin = _yMax = 0;
+}
+
+bool Scenario::load(const string& fileName)
+{
+	std::ifstream input(fileName);
+	if (input.fail())
+	{
+		std::cerr << "Cannot read scenario file" << std::endl;
+		return false;
+	}
+
+	_agents.clear();
+	_sources.clear();
+	_sinks.clear();
+	_obstacles.clear();
+
+	input >> _xMin;
+	input >> _xMax;
+	input >> _yMin;
+	input >> _yMax;
+
+	// Read the default parameters for the agents	
+	int nrAgents;
+	input >> nrAgents;
+	AgentInitialParameters par;
+	par.velocity = Vector2D(0, 0); // assume agents start at rest
+	par.goalRadius = 1.; // assume a fixed goal radius for all agents 
+	par.maxSpeed = 2.; // assume a fixed maxspeed (actually is not being currently used)
+	par.id = 0; // the id and spawn time are set by the engine
+	par.spawnTime = 0.;
+
+	for (int i = 0; i < nrAgents; ++i)
+	{
+		input >> par.gid;
+		input >> par.position.x();
+		input >> par.position.y();
+		input >> par.goal.x();
+		input >> par.goal.y();
+		input >> par.prefSpeed;
+		input >> par.radius;
+		_agents.push_back(par);
+	}
+
+	// Optionally read the sources, the sinks and the obstacles
+	string section;
+	while (input >> section)
+	{
+		int count;
+		input >> count;
+		for (int i = 0; i < count; ++i)
+		{
+			if (section == "sources")
+			{
+				SpawnSource source;
+				input >> source.startTime >> source.endTime >> source.rate;
+				input >> source.region.min.x() >> source.region.max.x() >> source.region.min.y() >> source.region.max.y();
+				input >> source.goalRegion.min.x() >> source.goalRegion.max.x() >> source.goalRegion.min.y() >> source.goalRegion.max.y();
+				input >> source.prefSpeed >> source.radius >> source.gid;
+				source.goalRadius = par.goalRadius;
+				_sources.push_back(source);
+			}
+			else if (section == "sinks")
+			{
+				SpawnRegion sink;
+				input >> sink.min.x() >> sink.max.x() >> sink.min.y() >> sink.max.y();
+				_sinks.push_back(sink);
+			}
+			else if (section == "obstacles")
+			{
+				int nrVertices = 0;
+				input >> nrVertices;
+				if (nrVertices < 2)
+				{
+					std::cerr << "An obstacle needs at least two vertices" << std::endl;
+					return false;
+				}
+				vector<Vector2D> vertices(nrVertices);
+				for (int v = 0; v < nrVertices; ++v)
+					input >> vertices[v].x() >> vertices[v].y();
+				_obstacles.push_back(vertices);
+			}
+			else
+			{
+				std::cerr << "Unknown section in the scenario file: " << section << std::endl;
+				return false;
+			}
+		}
+	}
+
+	if (input.bad() || (input.fail() && !input.eof()))
+	{
+		std::cerr << "Error reading the scenario file" << std::endl;
+		return false;
+	}
+
+	input.close();
+	return true;
+}
+
+void Scenario::populate(ImplicitEngine& engine) const
+{
+	//initialize the engine, given the dimensions of the environment
+	engine.init(_xMax - _xMin, _yMax - _yMin, 10, 10);
+
+	for (size_t i = 0; i < _agents.size(); ++i)
+	{
+		AgentInitialParameters par = _agents[i];
+		engine.addAgent(par);
+	}
+	for (size_t i = 0; i < _sources.size(); ++i)
+		engine.addSource(_sources[i]);
+	for (size_t i = 0; i < _sinks.size(); ++i)
+		engine.addSink(_sinks[i]);
+	for (size_t i = 0; i < _obstacles.size(); ++i)
+		engine.addObstacle(_obstacles[i]);
+}
@@ -0,0 +1,89 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "SolverStats.h"
+#include <fstream>
+#include <iostream>
+
+
+void StepStats::reset(int step, double time)
+{
+	this->step = step;
+	this->time = time;
+	timeStep = 0;
+	activeAgents = isolatedAgents = fineAgents = pairs = 0;
+	iterations = restarts = acceleratedSteps = 0;
+	lineSearchEvaluations = backtracks = infeasibleEvaluations = 0;
+	gradientNorm = convergenceGap = 0;
+	deadlineHit = 0;
+	doStepTime = neighborTime = solveTime = updateTime = 0;
+}
+
+bool writeStats(const vector<StepStats>& stats, const string& fileName)
+{
+	std::ofstream output(fileName);
+	if (output.fail())
+	{
+		std::cerr << "Cannot write statistics file" << std::endl;
+		return false;
+	}
+
+	bool json = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+	const char* names[] = { "step", "time", "timeStep", "activeAgents", "isolatedAgents", "fineAgents", "pairs", "iterations", "restarts", "acceleratedSteps", "lineSearchEvaluations",
+		"backtracks", "infeasibleEvaluations", "gradientNorm", "convergenceGap", "deadlineHit", "doStepTime", "neighborTime", "solveTime", "updateTime" };
+	const int noFields = sizeof(names) / sizeof(names[0]);
+
+	if (json)
+		output << "[\n";
+	else
+	{
+		for (int f = 0; f < noFields; ++f)
+			output << (f > 0 ? "," : "") << names[f];
+		output << "\n";
+	}
+
+	output.precision(10);
+	for (size_t i = 0; i < stats.size(); ++i)
+	{
+		const StepStats& s = stats[i];
+		double values[] = { (double)s.step, s.time, s.timeStep, (double)s.activeAgents, (double)s.isolatedAgents, (double)s.fineAgents, (double)s.pairs, (double)s.iterations, (double)s.restarts, (double)s.acceleratedSteps,
+			(double)s.lineSearchEvaluations, (double)s.backtracks, (double)s.infeasibleEvaluations, s.gradientNorm, s.convergenceGap, (double)s.deadlineHit,
+			s.doStepTime, s.neighborTime, s.solveTime, s.updateTime };
+		if (json)
+		{
+			output << "  {";
+			for (int f = 0; f < noFields; ++f)
+				output << (f > 0 ? ", " : "") << "\"" << names[f] << "\": " << values[f];
+			output << (i + 1 < stats.size() ? "},\n" : "}\n");
+		}
+		else
+		{
+			for (int f = 0; f < noFields; ++f)
+				output << (f > 0 ? "," : "") << values[f];
+			output << "\n";
+		}
+	}
+	if (json)
+		output << "]\n";
+
+	output.close();
+	return true;
+}
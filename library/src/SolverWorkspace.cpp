@@ -0,0 +1,75 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "SolverWorkspace.h"
+#include <algorithm>
+#include <new>
+
+
+SolverWorkspace::SolverWorkspace() : vNew(NULL, 0), posNew(NULL, 0), grad(NULL, 0), q(NULL, 0), xOld(NULL, 0), gradOld(NULL, 0),
+	sTemp(NULL, 0), yTemp(NULL, 0), trial(NULL, 0), scale(NULL, 0), momentum(NULL, 0), best(NULL, 0), s(NULL, 0, 0), y(NULL, 0, 0), gLast(NULL, 0), fLast(NULL, 0),
+	dG(NULL, 0, 0), dF(NULL, 0, 0)
+{
+	_capacity = _window = _mixingWindow = 0;
+	_allocations = 0;
+}
+
+void SolverWorkspace::resize(int noVars, int window, int mixingWindow)
+{
+	if (noVars > _capacity || window != _window || mixingWindow != _mixingWindow)
+	{
+		// the history of the problem changes with the windows, so it does not have to be kept
+		_capacity = std::max(noVars, _capacity + _capacity / 2);
+		_window = window;
+		_mixingWindow = mixingWindow;
+		const int mixingVectors = mixingWindow > 0 ? 2 + 2 * mixingWindow : 0;
+		_buffer.resize((Eigen::DenseIndex)_capacity*(_noVectors + 2 * window + mixingVectors));
+		alpha.resize(window);
+		rho.resize(window);
+		normal.resize(mixingWindow, mixingWindow);
+		gamma.resize(mixingWindow);
+		++_allocations;
+	}
+
+	// maps are pointed to other memory by constructing them again in place
+	double* next = _buffer.data();
+	VectorView* vectors[_noVectors] = { &vNew, &posNew, &grad, &q, &xOld, &gradOld, &sTemp, &yTemp, &trial, &scale, &momentum, &best };
+	for (int v = 0; v < _noVectors; ++v, next += _capacity)
+		new (vectors[v]) VectorView(next, noVars);
+	// the columns of the history are packed, so each one starts noVars after the previous one
+	new (&s) MatrixView(next, noVars, window);
+	new (&y) MatrixView(next + (Eigen::DenseIndex)_capacity*window, noVars, window);
+	next += (Eigen::DenseIndex)_capacity * 2 * window;
+	if (_mixingWindow > 0)
+	{
+		new (&gLast) VectorView(next, noVars);
+		new (&fLast) VectorView(next + _capacity, noVars);
+		new (&dG) MatrixView(next + 2 * (Eigen::DenseIndex)_capacity, noVars, _mixingWindow);
+		new (&dF) MatrixView(next + (Eigen::DenseIndex)_capacity*(2 + _mixingWindow), noVars, _mixingWindow);
+	}
+	else
+	{
+		new (&gLast) VectorView(NULL, 0);
+		new (&fLast) VectorView(NULL, 0);
+		new (&dG) MatrixView(NULL, 0, 0);
+		new (&dF) MatrixView(NULL, 0, 0);
+	}
+}
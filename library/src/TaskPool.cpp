@@ -0,0 +1,299 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "TaskPool.h"
+#include <algorithm>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <fstream>
+#include <sstream>
+#endif
+
+/// How many times an idle worker yields before it sleeps. A solve starts its loops a few microseconds apart
+static const int spinCount = 2000;
+
+/// Returns the cores this process may run on, node by node
+static vector<int> coresByNode()
+{
+	vector<int> cores;
+#ifdef _WIN32
+	// the cores of the first processor group, which holds all cores of machines with up to 64 of them
+	DWORD_PTR processMask, systemMask;
+	ULONG highestNode = 0;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) || !GetNumaHighestNodeNumber(&highestNode))
+		return cores;
+	for (ULONG node = 0; node <= highestNode; ++node)
+	{
+		ULONGLONG nodeMask = 0;
+		if (!GetNumaNodeProcessorMask((UCHAR)node, &nodeMask))
+			continue;
+		for (int core = 0; core < 64; ++core)
+			if ((nodeMask & processMask) >> core & 1)
+				cores.push_back(core);
+	}
+#elif defined(__linux__)
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+		return cores;
+	// the cores of each node are listed as ranges, e.g. 0-7,16-23
+	for (int node = 0; node < 64; ++node)
+	{
+		std::ifstream list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		string range;
+		while (std::getline(list, range, ','))
+		{
+			std::istringstream bounds(range);
+			int first = 0, last;
+			char dash;
+			bounds >> first;
+			if (!(bounds >> dash >> last))
+				last = first;
+			for (int core = first; core <= last && core < CPU_SETSIZE; ++core)
+				if (CPU_ISSET(core, &allowed))
+					cores.push_back(core);
+		}
+	}
+	// without NUMA information, in the order of the affinity mask
+	if (cores.empty())
+	{
+		for (int core = 0; core < CPU_SETSIZE; ++core)
+			if (CPU_ISSET(core, &allowed))
+				cores.push_back(core);
+	}
+#endif
+	return cores;
+}
+
+/// Restricts the calling thread to the given cores
+static void setThreadCores(const vector<int>& cores)
+{
+	if (cores.empty())
+		return;
+#ifdef _WIN32
+	DWORD_PTR mask = 0;
+	for (size_t c = 0; c < cores.size(); ++c)
+		mask |= (DWORD_PTR)1 << cores[c];
+	SetThreadAffinityMask(GetCurrentThread(), mask);
+#elif defined(__linux__)
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	for (size_t c = 0; c < cores.size(); ++c)
+		CPU_SET(cores[c], &mask);
+	pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+#endif
+}
+
+/// Restricts the calling thread to the given core. Returns the cores it could run on before, or nothing if they are unknown
+static vector<int> pinToCore(int core)
+{
+	vector<int> previous;
+#ifdef _WIN32
+	DWORD_PTR mask = SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core);
+	for (int c = 0; c < 64; ++c)
+		if (mask >> c & 1)
+			previous.push_back(c);
+#elif defined(__linux__)
+	cpu_set_t mask;
+	if (pthread_getaffinity_np(pthread_self(), sizeof(mask), &mask) == 0)
+	{
+		for (int c = 0; c < CPU_SETSIZE; ++c)
+			if (CPU_ISSET(c, &mask))
+				previous.push_back(c);
+	}
+	setThreadCores(vector<int>(1, core));
+#endif
+	return previous;
+}
+
+
+TaskPool::TaskPool()
+{
+	_function = NULL;
+	_task = NULL;
+	_steal = true;
+	_firstCore = 0;
+	_generation = 0;
+	_busy = 0;
+	_stop = false;
+	_ranges.reset(new Range[1]);
+}
+
+TaskPool::~TaskPool()
+{
+	resize(1);
+}
+
+void TaskPool::resize(int threads, bool pinned, int firstCore)
+{
+	threads = max(1, threads);
+	if (threads == size() && pinned == !_cores.empty() && (!pinned || firstCore == _firstCore))
+		return;
+
+	if (!_workers.empty())
+	{
+		{
+			lock_guard<mutex> lock(_mutex);
+			_stop = true;
+			++_generation;
+		}
+		_wake.notify_all();
+		for (size_t t = 0; t < _workers.size(); ++t)
+			_workers[t].join();
+		_workers.clear();
+		_stop = false;
+	}
+
+	// the cores are read with the calling thread unpinned, since on Linux they are those of the thread
+	unpinCaller();
+	_cores.clear();
+	if (pinned)
+		_cores = coresByNode();
+	_firstCore = max(0, firstCore);
+	_ranges.reset(new Range[threads]);
+	for (int t = 0; t < threads; ++t)
+		_ranges[t].chunks = 0;
+	// the workers start from the current generation, so that they cannot miss a loop started right away
+	const unsigned int generation = _generation;
+	for (int t = 1; t < threads; ++t)
+		_workers.push_back(std::thread(&TaskPool::work, this, t, generation));
+}
+
+void TaskPool::runTask(int noChunks, TaskFunction function, const void* task, bool steal)
+{
+	if (noChunks <= 0)
+		return;
+	// the calling thread runs the first range, so it is pinned as well, e.g. for the loops that place the agent state on the nodes
+	if (!_cores.empty() && _pinnedCaller != std::this_thread::get_id())
+	{
+		unpinCaller();
+		_callerCores = pinToCore(core(0));
+		_pinnedCaller = std::this_thread::get_id();
+	}
+	if (_workers.empty() || noChunks == 1)
+	{
+		for (int c = 0; c < noChunks; ++c)
+			function(task, c, 0);
+		return;
+	}
+
+	// deal contiguous ranges of chunks, which the threads rebalance by stealing if allowed
+	const int n = size();
+	for (int t = 0; t < n; ++t)
+		_ranges[t].chunks.store(pack(t*noChunks / n, (t + 1)*noChunks / n), std::memory_order_relaxed);
+	_function = function;
+	_task = task;
+	_steal = steal;
+	_busy = n - 1;
+	{
+		lock_guard<mutex> lock(_mutex);
+		++_generation;
+	}
+	_wake.notify_all();
+
+	execute(0);
+	// the last chunks are already running, so the wait is short
+	while (_busy > 0)
+		std::this_thread::yield();
+	_task = NULL;
+}
+
+void TaskPool::work(int thread, unsigned int generation)
+{
+	if (!_cores.empty())
+		pinToCore(core(thread));
+	while (true)
+	{
+		for (int s = 0; s < spinCount && _generation == generation; ++s)
+			std::this_thread::yield();
+		if (_generation == generation)
+		{
+			unique_lock<mutex> lock(_mutex);
+			_wake.wait(lock, [&]() { return _generation != generation; });
+		}
+		if (_stop)
+			return;
+		generation = _generation;
+		execute(thread);
+		--_busy;
+	}
+}
+
+void TaskPool::unpinCaller()
+{
+	// a thread that no longer drives the pool keeps its core, since only a thread can be relied upon to change its own affinity
+	if (_pinnedCaller == std::this_thread::get_id())
+		setThreadCores(_callerCores);
+	_pinnedCaller = std::thread::id();
+	_callerCores.clear();
+}
+
+void TaskPool::execute(int thread)
+{
+	int chunk;
+	while (pop(thread, chunk) || (_steal && steal(thread, chunk)))
+		_function(_task, chunk, thread);
+}
+
+bool TaskPool::pop(int thread, int& chunk)
+{
+	std::atomic<unsigned long long>& chunks = _ranges[thread].chunks;
+	unsigned long long range = chunks.load();
+	while (true)
+	{
+		const unsigned int begin = (unsigned int)range, end = (unsigned int)(range >> 32);
+		if (begin >= end)
+			return false;
+		if (chunks.compare_exchange_weak(range, pack(begin + 1, end)))
+		{
+			chunk = begin;
+			return true;
+		}
+	}
+}
+
+bool TaskPool::steal(int thread, int& chunk)
+{
+	const int n = size();
+	for (int k = 1; k < n; ++k)
+	{
+		std::atomic<unsigned long long>& victim = _ranges[(thread + k) % n].chunks;
+		unsigned long long range = victim.load();
+		while (true)
+		{
+			const unsigned int begin = (unsigned int)range, end = (unsigned int)(range >> 32);
+			if (begin >= end)
+				break;
+			// the upper half, or the last chunk, becomes the range of the thief
+			const unsigned int middle = begin + (end - begin) / 2;
+			if (victim.compare_exchange_weak(range, pack(begin, middle)))
+			{
+				chunk = middle;
+				_ranges[thread].chunks = pack(middle + 1, end);
+				return true;
+			}
+		}
+	}
+	return false;
+}
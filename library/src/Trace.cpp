@@ -0,0 +1,170 @@
+// Implicit Crowds
+// Copyright (c) 2018, Ioannis Karamouzas 
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// Original author: Ioannis Karamouzas <http://cs.clemson.edu/~ioannis/>
+
+#include "Trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	/// A complete span
+	struct TraceEvent
+	{
+		const char* name;
+		double start, end;
+		const char* argName;
+		long long arg;
+	};
+
+	/// A block of events of a single thread
+	struct TraceChunk
+	{
+		int tid;
+		std::vector<TraceEvent> events;
+	};
+
+	/// The number of events per chunk
+	const size_t chunkSize = 1 << 14;
+
+	/// Everything below is protected by the mutex, except for the thread-local state
+	std::mutex traceMutex;
+	std::ofstream traceOutput;
+	bool firstEvent;
+	int nextTid;
+	std::vector<TraceChunk*> fullChunks;
+	std::vector<TraceChunk*> openChunks;
+	std::atomic<bool> traceEnabled(false);
+	std::atomic<int> traceGeneration(0);
+	std::chrono::steady_clock::time_point traceOrigin;
+
+	/// The chunk the calling thread records into, valid if it belongs to the current recording
+	thread_local TraceChunk* localChunk = NULL;
+	thread_local int localGeneration = -1;
+
+	void writeChunk(const TraceChunk* chunk)
+	{
+		for (size_t i = 0; i < chunk->events.size(); ++i)
+		{
+			const TraceEvent& e = chunk->events[i];
+			traceOutput << (firstEvent ? "" : ",\n") << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << chunk->tid
+				<< ",\"ts\":" << e.start << ",\"dur\":" << e.end - e.start;
+			if (e.argName != NULL)
+				traceOutput << ",\"args\":{\"" << e.argName << "\":" << e.arg << "}";
+			traceOutput << "}";
+			firstEvent = false;
+		}
+	}
+}
+
+
+bool Trace::start(const string& fileName)
+{
+	std::lock_guard<std::mutex> lock(traceMutex);
+	traceOutput.open(fileName);
+	if (traceOutput.fail())
+	{
+		std::cerr << "Cannot write trace file" << std::endl;
+		return false;
+	}
+	traceOutput.precision(15);
+	traceOutput << "{\"traceEvents\":[\n";
+	firstEvent = true;
+	nextTid = 0;
+	traceOrigin = std::chrono::steady_clock::now();
+	++traceGeneration;
+	traceEnabled = true;
+	return true;
+}
+
+bool Trace::enabled()
+{
+	return traceEnabled.load(std::memory_order_relaxed);
+}
+
+double Trace::now()
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - traceOrigin).count();
+}
+
+void Trace::record(const char* name, double start, double end, const char* argName, long long arg)
+{
+	// a scope that ends after stop() records nothing, since no later flush() or stop() would write or free its chunk
+	if (!traceEnabled.load(std::memory_order_relaxed))
+		return;
+	if (localGeneration != traceGeneration || localChunk->events.size() == chunkSize)
+	{
+		// first event of this thread, or the chunk is full: hand it over and start a new one
+		std::lock_guard<std::mutex> lock(traceMutex);
+		if (!traceEnabled)
+			return;
+		TraceChunk* chunk = new TraceChunk();
+		if (localGeneration == traceGeneration)
+		{
+			chunk->tid = localChunk->tid;
+			openChunks.erase(std::find(openChunks.begin(), openChunks.end(), localChunk));
+			fullChunks.push_back(localChunk);
+		}
+		else
+			chunk->tid = nextTid++;
+		chunk->events.reserve(chunkSize);
+		openChunks.push_back(chunk);
+		localChunk = chunk;
+		localGeneration = traceGeneration;
+	}
+	TraceEvent e = { name, start, end, argName, arg };
+	localChunk->events.push_back(e);
+}
+
+void Trace::flush()
+{
+	std::lock_guard<std::mutex> lock(traceMutex);
+	if (!traceEnabled)
+		return;
+	for (size_t i = 0; i < fullChunks.size(); ++i)
+	{
+		writeChunk(fullChunks[i]);
+		delete fullChunks[i];
+	}
+	fullChunks.clear();
+	traceOutput.flush();
+}
+
+void Trace::stop()
+{
+	flush();
+	std::lock_guard<std::mutex> lock(traceMutex);
+	traceEnabled = false;
+	for (size_t i = 0; i < openChunks.size(); ++i)
+	{
+		writeChunk(openChunks[i]);
+		delete openChunks[i];
+	}
+	openChunks.clear();
+	// the chunks of the threads are gone; they will start new ones if recording starts again
+	++traceGeneration;
+	traceOutput << "\n]}\n";
+	traceOutput.close();
+}
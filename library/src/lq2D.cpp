@@ -60,7 +60,7 @@
 
 #include <stdlib.h>
 #include <float.h>
-#include "proximitydatabase/lq2D.h"
+#include "proximitydatabase/lq2d.h"
 
 /* ------------------------------------------------------------------ */
 /* Allocate and initialize an LQ database, return a pointer to it.